@@ -0,0 +1,50 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+inline size_t arena_size(size_t size) {
+	return (size+ARENA_ALIGN-1) & ~(size_t)(ARENA_ALIGN-1);
+}
+
+int arena_init(tArena * a, size_t size, tPages pages) {
+	void * base=MAP_FAILED;
+
+	size=(size+HUGE_PAGE_SIZE-1) & ~(HUGE_PAGE_SIZE-1);
+#ifdef MAP_HUGETLB
+	if (pages==PAGES_HUGETLB) {
+		base=mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (base==MAP_FAILED)
+			fprintf(stderr, "No huge pages reserved for %lu MB, using transparent huge pages\n", size>>20);
+	}
+#endif
+	if (base==MAP_FAILED) {
+		base=mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (base==MAP_FAILED) return -1;
+#ifdef MADV_HUGEPAGE
+		if (pages!=PAGES_NORMAL) madvise(base, size, MADV_HUGEPAGE);
+#endif
+	}
+	memset(base, 0, size);		// first touch by this thread
+	a->base=base;
+	a->size=size;
+	a->used=0;
+	return 0;
+}
+
+void arena_free(tArena * a) {
+	munmap(a->base, a->size);
+	a->base=NULL;
+	a->size=a->used=0;
+}
+
+void * arena_alloc(tArena * a, size_t size) {
+	void * p;
+
+	size=arena_size(size);
+	if (a->used+size > a->size) return NULL;
+	p=a->base+a->used;
+	a->used+=size;
+	return p;
+}
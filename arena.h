@@ -0,0 +1,35 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_ALIGN 64			// cache line
+#define HUGE_PAGE_SIZE (2UL<<20)
+
+typedef enum {PAGES_NORMAL, PAGES_THP, PAGES_HUGETLB} tPages;
+
+/**
+ * Memory of one thread, mapped at once and then handed out by a bump pointer,
+ * never freed piece by piece. The pages are touched by the thread which calls
+ * arena_init(), so the first-touch policy puts them on its NUMA node.
+ */
+typedef struct {
+	char * base;
+	size_t size, used;
+} tArena;
+
+/**
+ * @param pages PAGES_THP asks for transparent huge pages, PAGES_HUGETLB for
+ * 		  the reserved ones (falls back to PAGES_THP if there are none)
+ * @return 0 on success, -1 for insufficient memory
+ */
+int arena_init(tArena * a, size_t size, tPages pages);
+void arena_free(tArena * a);
+/**
+ * @return ARENA_ALIGN aligned memory, NULL if the arena is full
+ */
+void * arena_alloc(tArena * a, size_t size);
+// the arena space taken by arena_alloc(size)
+inline size_t arena_size(size_t size);
+
+#endif
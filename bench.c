@@ -0,0 +1,363 @@
+/**
+ * Benchmarks of the simulator, the fitness evaluation, the population queues and the whole
+ * evolution, on fixed seeded workloads. Each measurement is repeated, the best throughput is kept.
+ * Prints the throughputs as JSON, which can be saved and given back as the baseline:
+ * then each metric is compared with it and the regressions beyond the tolerance are flagged.
+ *
+ * gcc -std=gnu99 -fgnu89-inline -O2 -fopenmp bench.c arena.c checkpoint.c cluster.c dpqueue.c evolve_turing.c \
+ *     fitness_cache.c island.c pqueue.c prng.c results.c snapshot.c stats.c turing.c turing_batch.c turing_jit.c rle_tape.c samples.c \
+ *     -o bench -lm -lpthread
+ * ./bench [-r REPEATS] [-g GENERATIONS] [-b BASELINE] [-t TOLERANCE] > bench.json
+ * @return 1 if any metric regressed against the baseline
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <omp.h>
+#include "common.h"
+#include "turing.h"
+#include "evolve_turing.h"
+#include "samples.h"
+#include "pqueue.h"
+#include "dpqueue.h"
+#include "prng.h"
+
+#define METRICS_MAX 128
+#define RANDOM_MACHINES 1000
+#define DEMO_RUNS 20000		// evaluations of demoBubble
+#define LONG_TAPE_LEN 1000	// demoBubble sorts it in millions of steps, a run long enough for the JIT
+#define LONG_RUNS 3
+#define RUNS_TAPE_LEN 1000000	// of runs of 1..2*RUNS_LEN_AVG cells, for the run-length encoded tapes
+#define RUNS_LEN_AVG 1000
+#define RUNS_MACHINES 100
+#define QUEUE_OPS 1000000
+#define SEED 1
+
+volatile int log_level=LOG_NONE_0;
+
+char * Engine_names[ENGINES]={"reference", "fast", "batch", "jit"};
+
+struct {
+	char name[64], * unit;
+	double value;
+} Metrics[METRICS_MAX];
+int Metrics_cnt;
+int Repeats=3;
+
+static double now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+// records the throughput, the name is formatted by printf
+static void metric(double value, char * unit, char * name, ...) {
+	va_list args;
+
+	if (Metrics_cnt==METRICS_MAX) {
+		fprintf(stderr, "Too many metrics!\n");
+		exit(-1);
+	}
+	va_start(args, name);
+	vsnprintf(Metrics[Metrics_cnt].name, sizeof(Metrics[0].name), name, args);
+	va_end(args);
+	Metrics[Metrics_cnt].unit=unit;
+	Metrics[Metrics_cnt].value=value;
+	fprintf(stderr, "%-32s %14.1lf %s\n", Metrics[Metrics_cnt].name, value, unit);
+	Metrics_cnt++;
+}
+
+// n random machines, as generated by the evolution
+static tTransitions * random_machines(int n, int states, int symbols) {
+	tTransitions * t=malloc(n*sizeof(tTransitions));
+	tTransTableItem * tables=malloc(n*states*symbols*sizeof(tTransTableItem));
+	int i, j;
+
+	if (t==NULL || tables==NULL) {
+		fprintf(stderr, "Can't allocate memory for the machines!\n");
+		exit(-1);
+	}
+	prng_seed(SEED, 0);
+	for (i=0; i<n; i++) {
+		t[i].states=states;
+		t[i].symbols=symbols;
+		t[i].table=tables+i*states*symbols;
+		t[i].used=NULL;
+		for (j=0; j<states*symbols; j++)
+			t[i].table[j]=TRANS_ITEM(prng_below(states+1), (int)prng_below(symbols+1)-1, prng_below(SHIFTS));
+	}
+	return t;
+}
+
+// a seeded random input of symbols 1..3 between the BLANKs
+static tTape long_tape(void) {
+	tTape tape={malloc(LONG_TAPE_LEN), LONG_TAPE_LEN};
+	int i;
+
+	prng_seed(SEED, 0);
+	for (i=0; i<LONG_TAPE_LEN; i++)
+		tape.content[i]=i==0 || i==LONG_TAPE_LEN-1 ? BLANK : 1+prng_below(3);
+	return tape;
+}
+
+// a seeded random input of runs of the symbols 1..3 between the BLANKs
+static tTape runs_tape(void) {
+	tTape tape={malloc(RUNS_TAPE_LEN), RUNS_TAPE_LEN};
+	int i, len;
+
+	prng_seed(SEED, 0);
+	tape.content[0]=tape.content[RUNS_TAPE_LEN-1]=BLANK;
+	for (i=1; i<RUNS_TAPE_LEN-1; i+=len) {
+		len=1+prng_below(2*RUNS_LEN_AVG);
+		if (len>RUNS_TAPE_LEN-1-i) len=RUNS_TAPE_LEN-1-i;
+		memset(tape.content+i, 1+prng_below(3), len);
+	}
+	return tape;
+}
+
+// @return steps per second of the machines t[0..n-1], each run runs times on all the tapes
+static double steps_rate(tTransitions * t, int n, tTape * tapes, int tapes_cnt, int runs) {
+	static tTape work;
+	tStatus status;
+	double t0=now(), steps=0;
+	int i, j, k;
+
+	for (k=0; k<runs; k++)
+		for (i=0; i<n; i++)
+			for (j=0; j<tapes_cnt; j++) {
+				memset(&status, 0, sizeof(status));
+				status.head=HEAD_START;
+				init_tape(tapes+j, &work);
+				turing_engine(&work, t+i, get_max_steps(tapes[j].input_len), &status);
+				steps+=status.steps;
+			}
+	return steps/(now()-t0);
+}
+
+// @return evaluations per second of the machines t[0..n-1], each evaluated runs times
+static double eval_rate(tTransitions * t, int n, int runs, tEngine engine) {
+	double t0=now(), * fitness=malloc(n*sizeof(double));
+	int i, k;
+
+	for (k=0; k<runs; k++)
+		if (engine==ENGINE_BATCH)
+			for (i=0; i<n; i+=BATCH_KIDS)
+				eval_sorting_fitness_batch(t+i, n-i<BATCH_KIDS ? n-i : BATCH_KIDS, Sample_tapes, NR_OF_SAMPLE_TAPES,
+						NULL, NO_THRESHOLD, fitness+i);
+		else
+			for (i=0; i<n; i++)
+				fitness[i]=eval_sorting_fitness_n_tapes(t+i, Sample_tapes, NR_OF_SAMPLE_TAPES);
+	free(fitness);
+	return (double)n*runs/(now()-t0);
+}
+
+static void bench_engines(void) {
+	tTransitions * random=random_machines(RANDOM_MACHINES, 12, SAMPLE_TAPE_SYMBOLS);
+	tTape long_input=long_tape();
+	tEngine e;
+	double best;
+	int r, old_loop_check=loop_check;
+
+	for (e=ENGINE_REFERENCE; e<ENGINES; e++) {
+		if (e!=ENGINE_BATCH) {		// the steps themselves, without skipping the loops
+			set_turing_engine(e, demoBubble.states, demoBubble.symbols);
+			loop_check=0;
+			for (r=0, best=0; r<Repeats; r++) best=fmax(best, steps_rate(&demoBubble, 1, Sample_tapes, NR_OF_SAMPLE_TAPES, DEMO_RUNS));
+			metric(best, "steps/s", "steps.demo_bubble.%s", Engine_names[e]);
+			for (r=0, best=0; r<Repeats; r++) best=fmax(best, steps_rate(&demoBubble, 1, &long_input, 1, LONG_RUNS));
+			metric(best, "steps/s", "steps.demo_bubble_long.%s", Engine_names[e]);
+			loop_check=old_loop_check;
+			for (r=0, best=0; r<Repeats; r++) best=fmax(best, eval_rate(&demoBubble, 1, DEMO_RUNS, e));
+			metric(best, "evaluations/s", "eval.demo_bubble.%s", Engine_names[e]);
+			set_turing_engine(e, random->states, random->symbols);
+			loop_check=0;
+			for (r=0, best=0; r<Repeats; r++) best=fmax(best, steps_rate(random, RANDOM_MACHINES, Sample_tapes, NR_OF_SAMPLE_TAPES, 1));
+			metric(best, "steps/s", "steps.random.%s", Engine_names[e]);
+			loop_check=old_loop_check;
+		}
+		set_turing_engine(e, random->states, random->symbols);
+		for (r=0, best=0; r<Repeats; r++) best=fmax(best, eval_rate(random, RANDOM_MACHINES, 1, e));
+		metric(best, "evaluations/s", "eval.random.%s", Engine_names[e]);
+	}
+	free(random->table);
+	free(random);
+	free(long_input.content);
+}
+
+// the evaluation on a long tape of runs: flat and run-length encoded, see set_rle_tapes()
+static void bench_rle(void) {
+	tTransitions * random=random_machines(RUNS_MACHINES, 12, SAMPLE_TAPE_SYMBOLS);
+	tTape runs=runs_tape();
+	tTapeMetrics metrics;
+	double t0, best;
+	int r, i, rle;
+
+	calc_all_tapes_metrics(&runs, &metrics, 1);
+	set_turing_engine(ENGINE_FAST, random->states, random->symbols);
+	for (rle=0; rle<2; rle++) {
+		set_rle_tapes(&runs, 1, rle ? 1 : 0);
+		for (r=0, best=0; r<Repeats; r++) {
+			t0=now();
+			for (i=0; i<RUNS_MACHINES; i++) eval_sorting_fitness_n_tapes(random+i, &runs, 1);
+			best=fmax(best, RUNS_MACHINES/(now()-t0));
+		}
+		metric(best, "evaluations/s", "eval.random_runs.%s", rle ? "rle" : "flat");
+	}
+	set_rle_tapes(&runs, 1, 0);
+	free(random->table);
+	free(random);
+	free(runs.content);
+}
+
+// the queue operations in the evolution's pattern: the worst individual is replaced by a kid
+static void bench_queues(void) {
+	int sizes[]={1000, 10000, 100000, 1000000}, k, n, i, r, j;
+	tIndividual * population;
+	pqueue_t * heap;
+	dpqueue_t * dpq;
+	double t0, insert[2], update[2], get[2];
+	volatile double sink=0;
+
+	for (k=0; k<sizeof(sizes)/sizeof(*sizes); k++) {
+		n=sizes[k];
+		insert[0]=insert[1]=update[0]=update[1]=get[0]=get[1]=0;
+		for (r=0; r<Repeats; r++) {
+			if ((population=malloc(n*sizeof(tIndividual)))==NULL ||
+					(heap=pqueue_init(n))==NULL || (dpq=dpqueue_init(n))==NULL) {
+				fprintf(stderr, "Can't allocate memory for the population of %d!\n", n);
+				exit(-1);
+			}
+			prng_seed(SEED, 0);
+			for (i=0; i<n; i++) population[i].fitness=(double)prng_next()/~0UL;
+			t0=now();
+			for (i=0; i<n; i++) pqueue_insert(heap, population+i);
+			insert[0]=fmax(insert[0], n/(now()-t0));
+			t0=now();
+			for (i=0; i<QUEUE_OPS; i++) {
+				pqueue_get(heap, n)->fitness=(double)prng_next()/~0UL;
+				pqueue_priority_changed(heap, 1.0, n);
+			}
+			update[0]=fmax(update[0], QUEUE_OPS/(now()-t0));
+			t0=now();
+			for (i=0; i<QUEUE_OPS; i++) sink+=pqueue_get(heap, 1+prng_below(n))->fitness;
+			get[0]=fmax(get[0], QUEUE_OPS/(now()-t0));
+
+			prng_seed(SEED, 0);
+			for (i=0; i<n; i++) population[i].fitness=(double)prng_next()/~0UL;
+			t0=now();
+			for (i=0; i<n; i++) dpqueue_insert(dpq, i, population[i].fitness);
+			insert[1]=fmax(insert[1], n/(now()-t0));
+			t0=now();
+			for (i=0; i<QUEUE_OPS; i++) {
+				j=dpqueue_get(dpq, n);
+				population[j].fitness=(double)prng_next()/~0UL;
+				dpqueue_priority_changed(dpq, n, population[j].fitness);
+			}
+			update[1]=fmax(update[1], QUEUE_OPS/(now()-t0));
+			t0=now();
+			for (i=0; i<QUEUE_OPS; i++) sink+=population[dpqueue_get(dpq, 1+prng_below(n))].fitness;
+			get[1]=fmax(get[1], QUEUE_OPS/(now()-t0));
+			pqueue_free(heap);
+			dpqueue_free(dpq);
+			free(population);
+		}
+		metric(insert[0], "ops/s", "pqueue.heap.%d.insert", n);
+		metric(update[0], "ops/s", "pqueue.heap.%d.update", n);
+		metric(get[0], "ops/s", "pqueue.heap.%d.get", n);
+		metric(insert[1], "ops/s", "pqueue.treap.%d.insert", n);
+		metric(update[1], "ops/s", "pqueue.treap.%d.update", n);
+		metric(get[1], "ops/s", "pqueue.treap.%d.get", n);
+	}
+}
+
+// the default evolution without the cache, in 1, 2, 4... threads, each with its own population
+static void bench_evolution(ulong generations) {
+	tParams params={10000, 12, 4, 5000, 10, 1000, NULL, ENGINE_FAST, 0, 0, 1, PAGES_THP, SEED, TOPOLOGY_NONE,
+			10, 5, 0, NULL, NULL, 0, 0, generations};
+	int threads, max_threads=omp_get_max_threads(), r;
+	double t0, best;
+
+	set_turing_engine(params.engine, params.states, params.symbols);
+	set_kernels(params.states, params.symbols);
+	for (threads=1; threads<=max_threads; threads=threads<max_threads && 2*threads>max_threads ? max_threads : 2*threads) {
+		for (r=0, best=0; r<Repeats; r++) {
+			t0=now();
+			#pragma omp parallel num_threads(threads)
+				evolve_turing(&params, Sample_tapes, NR_OF_SAMPLE_TAPES);
+			best=fmax(best, threads*generations/(now()-t0));
+		}
+		metric(best, "generations/s", "evolve.threads_%d", threads);
+	}
+}
+
+// @return the nr. of the metrics which regressed against the baseline file by more than tolerance
+static int compare(char * path, double tolerance) {
+	char line[1024], name[64], * p;
+	double base, change;
+	int i, regressions=0;
+	FILE * f;
+
+	if ((f=fopen(path, "r"))==NULL) {
+		fprintf(stderr, "Can't open the baseline %s!\n", path);
+		exit(-1);
+	}
+	fprintf(stderr, "\n%-32s %14s %14s %8s\n", "metric", "baseline", "current", "change");
+	while (fgets(line, sizeof(line), f)) {
+		if ((p=strstr(line, "\"name\":\""))==NULL || sscanf(p+strlen("\"name\":\""), "%63[^\"]", name)<1 ||
+				(p=strstr(line, "\"value\":"))==NULL)
+			continue;
+		base=strtod(p+strlen("\"value\":"), NULL);
+		for (i=0; i<Metrics_cnt && strcmp(Metrics[i].name, name); i++);
+		if (i==Metrics_cnt) {
+			fprintf(stderr, "%-32s %14.1lf %14s\n", name, base, "-");
+			continue;
+		}
+		change=base>0 ? Metrics[i].value/base-1 : 0;
+		fprintf(stderr, "%-32s %14.1lf %14.1lf %+7.1lf%%%s\n", name, base, Metrics[i].value, 100*change,
+				change < -tolerance ? "  REGRESSION" : "");
+		regressions+=change < -tolerance;
+	}
+	fclose(f);
+	return regressions;
+}
+
+int main(int argc, char ** argv) {
+	char * baseline=NULL;
+	double tolerance=0.05;
+	ulong generations=5;
+	tTapeMetrics metrics[NR_OF_SAMPLE_TAPES];
+	int i;
+
+	for (i=1; i+1<argc; i+=2) {
+		if (!strcmp(argv[i], "-r")) Repeats=atoi(argv[i+1]);
+		else if (!strcmp(argv[i], "-g")) generations=strtoul(argv[i+1], NULL, 10);
+		else if (!strcmp(argv[i], "-b")) baseline=argv[i+1];
+		else if (!strcmp(argv[i], "-t")) tolerance=atof(argv[i+1])/100;
+		else break;
+	}
+	if (i<argc || Repeats<1 || generations<1) {
+		fprintf(stderr, "%s [-r REPEATS] [-g GENERATIONS] [-b BASELINE] [-t TOLERANCE]\n"
+				"-r REPEATS\n	of each measurement, the best one is kept. Default is 3\n"
+				"-g GENERATIONS\n	evolved by each thread in the evolution benchmark. Default is 5\n"
+				"-b BASELINE\n	the JSON printed by an earlier run, the metrics are compared with it\n"
+				"-t TOLERANCE\n	the slowdown (in %%) which isn't a regression yet. Default is 5\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	calc_all_tapes_metrics(Sample_tapes, metrics, NR_OF_SAMPLE_TAPES);
+	bench_engines();
+	bench_rle();
+	bench_queues();
+	bench_evolution(generations);
+
+	printf("{\"bench\":{\"started\":%ld,\"repeats\":%d,\"generations\":%lu,\"max_threads\":%d,\"seed\":%d},\n\"metrics\":[\n",
+			(long)time(NULL), Repeats, generations, omp_get_max_threads(), SEED);
+	for (i=0; i<Metrics_cnt; i++)
+		printf("{\"name\":\"%s\",\"value\":%.1lf,\"unit\":\"%s\"}%s\n", Metrics[i].name, Metrics[i].value,
+				Metrics[i].unit, i<Metrics_cnt-1 ? "," : "");
+	printf("]}\n");
+	if (baseline && compare(baseline, tolerance)) return 1;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "turing.h"
+#include "checkpoint.h"
+
+void checkpoints_init(tRunCheckpoints * c, int table_size) {
+	c->count=0;
+	c->first_use=malloc(table_size);
+	c->checkpoints=calloc(CHECKPOINTS_MAX, sizeof(tCheckpoint));
+	if (c->first_use==NULL || c->checkpoints==NULL) {
+		fprintf(stderr, "Can't allocate memory for the checkpoints!\n");
+		exit(-1);
+	}
+}
+
+void checkpoints_free(tRunCheckpoints * c) {
+	int i;
+
+	for (i=0; i<CHECKPOINTS_MAX; i++)
+		free(c->checkpoints[i].content);
+	free(c->first_use);
+	free(c->checkpoints);
+}
+
+void turing_checkpoints(tTape * tape, tTransitions * t, int max_steps, tStatus * status,
+		int interval, tRunCheckpoints * c) {
+	int table_size=t->states*t->symbols, i, limit;
+	ulong used[USED_WORDS(table_size)];
+	tTransitions chunk=*t;
+	tCheckpoint * cp;
+
+	if (interval < (max_steps+CHECKPOINTS_MAX-1)/CHECKPOINTS_MAX)
+		interval=(max_steps+CHECKPOINTS_MAX-1)/CHECKPOINTS_MAX;
+	if (interval < 1) interval=1;
+	c->interval=interval;
+	memset(c->first_use, UNUSED_CHUNK, table_size);
+	chunk.used=used;
+	for (c->count=0; c->count<CHECKPOINTS_MAX; ) {
+		cp=c->checkpoints + c->count++;
+		cp->status=*status;
+		// nothing is written beyond head_max
+		cp->len=status->head_max+1;
+		if (cp->len > cp->capacity) {
+			if ((cp->content=realloc(cp->content, cp->len))==NULL) {
+				fprintf(stderr, "Can't allocate memory for the checkpoints!\n");
+				exit(-1);
+			}
+			cp->capacity=cp->len;
+		}
+		memcpy(cp->content, tape->content, cp->len);
+		memset(used, 0, sizeof(used));
+		limit=status->steps < max_steps-interval && c->count<CHECKPOINTS_MAX ? status->steps+interval : max_steps;
+		turing_engine(tape, &chunk, limit, status);
+		for (i=0; i<table_size; i++)
+			if (USED_GET(used, i) && c->first_use[i]==UNUSED_CHUNK) c->first_use[i]=c->count-1;
+		if (t->used)
+			for (i=0; i<USED_WORDS(table_size); i++) t->used[i]|=used[i];
+		if (status->steps >= max_steps || status->state >= t->states || status->error==ERR_BOUNDS)
+			break;
+	}
+}
+
+int checkpoint_find(tRunCheckpoints * c, tTransTableItem * recorded, tTransTableItem * table, int table_size) {
+	int i, chunk=UNUSED_CHUNK;
+
+	for (i=0; i<table_size; i++)
+		if (c->first_use[i] < chunk && memcmp(recorded+i, table+i, sizeof(tTransTableItem)))
+			chunk=c->first_use[i];
+	return chunk==UNUSED_CHUNK ? -1 : chunk;
+}
+
+void checkpoint_restore(tRunCheckpoints * c, int i, tTape * tape, tStatus * status, ulong * used, int table_size) {
+	tCheckpoint * cp=c->checkpoints+i;
+
+	tape_reserve(tape, cp->len);
+	memcpy(tape->content, cp->content, cp->len);
+	if (cp->len > tape->dirty) tape->dirty=cp->len;
+	*status=cp->status;
+	if (used) checkpoint_used(c, i, used, table_size);
+}
+
+void checkpoint_used(tRunCheckpoints * c, int i, ulong * used, int table_size) {
+	int item;
+
+	for (item=0; item<table_size; item++)
+		if (c->first_use[item] < i) USED_SET(used, item);
+}
@@ -0,0 +1,51 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "turing.h"
+
+#define CHECKPOINTS_MAX 64		// per run, the interval grows for longer runs
+#define UNUSED_CHUNK 0xFF
+
+typedef struct {
+	tStatus status;
+	int len;					// the tape prefix which may differ from the initial tape
+	schar * content;			// [capacity], grown with len
+	int capacity;
+} tCheckpoint;
+
+/**
+ * A run of one machine on one tape, cut into chunks of interval steps.
+ * The checkpoint i is the configuration at the start of the chunk i, first_use
+ * tells the chunk in which each table item was read for the first time.
+ * Another machine, which differs only in the items first used in the chunk i or later,
+ * runs identically up to the checkpoint i, so it can be resumed from there.
+ */
+typedef struct {
+	int interval, count;		// steps of a chunk, nr. of checkpoints
+	uchar * first_use;			// [table size], UNUSED_CHUNK for items never read
+	tCheckpoint * checkpoints;	// [CHECKPOINTS_MAX]
+} tRunCheckpoints;
+
+void checkpoints_init(tRunCheckpoints * c, int table_size);
+void checkpoints_free(tRunCheckpoints * c);
+/**
+ * Runs turing_engine from the initial configuration (tape, status) like the engine itself,
+ * saving checkpoints every interval steps, or more, if max_steps needs more than CHECKPOINTS_MAX.
+ */
+void turing_checkpoints(tTape * tape, tTransitions * t, int max_steps, tStatus * status,
+		int interval, tRunCheckpoints * c);
+/**
+ * @param recorded the table of the recorded run
+ * @return the checkpoint, from which the machine with the table can be resumed,
+ * 		   or -1 if the table differs in no item used by the recorded run
+ */
+int checkpoint_find(tRunCheckpoints * c, tTransTableItem * recorded, tTransTableItem * table, int table_size);
+/**
+ * Restores the configuration of the checkpoint i into the initial tape and status.
+ * The items read before it are set in used, if it's not NULL.
+ */
+void checkpoint_restore(tRunCheckpoints * c, int i, tTape * tape, tStatus * status, ulong * used, int table_size);
+// sets the items read before the chunk i in used
+void checkpoint_used(tRunCheckpoints * c, int i, ulong * used, int table_size);
+
+#endif
@@ -0,0 +1,401 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "cluster.h"
+
+#define HEADER_LEN 5
+
+tCluster * cluster=NULL;
+
+static size_t individual_size(int table_size) {
+	return sizeof(double)+USED_WORDS(table_size)*sizeof(ulong)+table_size*sizeof(tTransTableItem);
+}
+
+/**
+ * @param address "host:port" or a Unix socket path (with a '/'), the host may be empty for listening
+ * @return the listening or connected socket, -1 on error
+ */
+static int open_socket(char * address, int listening) {
+	struct addrinfo hints, * res, * ai;
+	struct sockaddr_un un;
+	char host[256], * port;
+	int fd=-1, one=1;
+
+	if (strchr(address, '/')) {
+		if (strlen(address) >= sizeof(un.sun_path) || (fd=socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+			return -1;
+		memset(&un, 0, sizeof(un));
+		un.sun_family=AF_UNIX;
+		strcpy(un.sun_path, address);
+		if (listening) unlink(address);
+		if (listening ? bind(fd, (struct sockaddr *)&un, sizeof(un)) || listen(fd, 16) :
+				connect(fd, (struct sockaddr *)&un, sizeof(un))) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+	if ((port=strrchr(address, ':'))==NULL || port-address >= sizeof(host))
+		return -1;
+	memcpy(host, address, port-address);
+	host[port-address]=0;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family=AF_UNSPEC;
+	hints.ai_socktype=SOCK_STREAM;
+	hints.ai_flags=listening ? AI_PASSIVE : 0;
+	if (getaddrinfo(host[0] ? host : NULL, port+1, &hints, &res))
+		return -1;
+	for (ai=res; ai; ai=ai->ai_next) {
+		if ((fd=socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+			continue;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		if (listening) {
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+			if (bind(fd, ai->ai_addr, ai->ai_addrlen)==0 && listen(fd, 16)==0) break;
+		} else if (connect(fd, ai->ai_addr, ai->ai_addrlen)==0) break;
+		close(fd);
+		fd=-1;
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+static int send_all(int fd, void * buf, size_t len, int flags) {
+	ssize_t sent;
+
+	while (len > 0) {
+		if ((sent=send(fd, buf, len, flags | MSG_NOSIGNAL)) < 0) {
+			if (errno==EINTR) continue;
+			return -1;
+		}
+		buf=(char *)buf+sent;
+		len-=sent;
+	}
+	return 0;
+}
+
+static int send_message(int fd, int type, void * payload, size_t len) {
+	unsigned char header[HEADER_LEN];
+	uint32_t l=htonl(len);
+
+	memcpy(header, &l, 4);
+	header[4]=type;
+	return send_all(fd, header, HEADER_LEN, len ? MSG_MORE : 0) || send_all(fd, payload, len, 0);
+}
+
+static void conn_init(tConnection * c, int fd) {
+	struct timeval timeout={CLUSTER_TIMEOUT, 0};
+
+	// a peer, who doesn't read, can't block the sender for long
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	c->fd=fd;
+	c->buf=NULL;
+	c->len=c->cap=0;
+	c->heard=time(NULL);
+}
+
+static void conn_close(tConnection * c) {
+	close(c->fd);
+	free(c->buf);
+	c->buf=NULL;
+}
+
+// reads what has come, @return -1 if the peer is gone
+static int conn_read(tConnection * c) {
+	ssize_t got;
+
+	while (1) {
+		if (c->cap-c->len < 65536) {
+			c->cap=2*c->cap+65536;
+			if ((c->buf=realloc(c->buf, c->cap))==NULL) {
+				fprintf(stderr, "Can't allocate memory for the messages!\n");
+				exit(-1);
+			}
+		}
+		got=recv(c->fd, c->buf+c->len, c->cap-c->len, MSG_DONTWAIT);
+		if (got > 0) {
+			c->len+=got;
+			c->heard=time(NULL);
+		} else if (got==0) return -1;
+		else if (errno==EAGAIN || errno==EWOULDBLOCK) return 0;
+		else if (errno!=EINTR) return -1;
+	}
+}
+
+/**
+ * @return 1 and the next complete message (valid until conn_consume()), 0 if there's none yet,
+ * 		   -1 for a broken stream
+ */
+static int conn_message(tConnection * c, int * type, char ** payload, size_t * len) {
+	uint32_t l;
+
+	if (c->len < HEADER_LEN) return 0;
+	memcpy(&l, c->buf, 4);
+	*len=ntohl(l);
+	if (*len > CLUSTER_MSG_MAX) return -1;
+	if (c->len < HEADER_LEN+*len) return 0;
+	*type=c->buf[4];
+	*payload=c->buf+HEADER_LEN;
+	return 1;
+}
+
+static void conn_consume(tConnection * c, size_t len) {
+	memmove(c->buf, c->buf+HEADER_LEN+len, c->len-HEADER_LEN-len);
+	c->len-=HEADER_LEN+len;
+}
+
+/*
+ * the coordinator
+ */
+typedef struct {
+	tConnection conn;
+	int id, table_size;		// table_size is 0 until the worker says hello
+} tWorker;
+
+typedef struct {
+	int table_size, cnt;
+	size_t size;			// of an individual
+	char * individuals;		// [CLUSTER_ELITES], the best first
+	int from[CLUSTER_ELITES];	// the worker's id
+} tElites;
+
+static double elite_fitness(char * individual) {
+	double fitness;
+	memcpy(&fitness, individual, sizeof(double));
+	return fitness;
+}
+
+static void elite_add(tElites * e, char * individual, int from) {
+	size_t table_offset=e->size-e->table_size*sizeof(tTransTableItem);
+	double fitness=elite_fitness(individual);
+	int i, j;
+
+	if (e->cnt==CLUSTER_ELITES && fitness <= elite_fitness(e->individuals+(e->cnt-1)*e->size))
+		return;
+	for (i=0; i<e->cnt; i++)
+		if (!memcmp(e->individuals+i*e->size+table_offset, individual+table_offset,
+				e->table_size*sizeof(tTransTableItem)))
+			return;		// known already
+	for (i=0; i<e->cnt && elite_fitness(e->individuals+i*e->size) >= fitness; i++);
+	j=e->cnt < CLUSTER_ELITES ? e->cnt++ : e->cnt-1;
+	memmove(e->individuals+(i+1)*e->size, e->individuals+i*e->size, (j-i)*e->size);
+	memmove(e->from+i+1, e->from+i, (j-i)*sizeof(int));
+	memcpy(e->individuals+i*e->size, individual, e->size);
+	e->from[i]=from;
+	if (i==0)
+		printf("Coordinator: new best fitness=%.6lf from worker %d\n", fitness, from);
+}
+
+// @return 0 if the worker is to be dropped
+static int handle_message(tWorker * w, tElites * e, int type, char * payload, size_t len) {
+	uint32_t table_size;
+	size_t n, i, cnt=0;
+	char * reply;
+
+	switch (type) {
+		case MSG_HELLO:
+			if (len!=4) return 0;
+			memcpy(&table_size, payload, 4);
+			if ((w->table_size=ntohl(table_size))!=e->table_size) {
+				fprintf(stderr, "Coordinator: worker %d has the table size %d, not %d\n",
+						w->id, w->table_size, e->table_size);
+				return 0;
+			}
+			return 1;
+		case MSG_HEARTBEAT:
+			return send_message(w->conn.fd, MSG_HEARTBEAT, NULL, 0)==0;
+		case MSG_MIGRANTS:
+			if (w->table_size==0 || len%e->size) return 0;
+			n=len/e->size;
+			for (i=0; i<n; i++) elite_add(e, payload+i*e->size, w->id);
+			// as many migrants back, from the other workers
+			if ((reply=malloc(n*e->size))==NULL) return 0;
+			for (i=0; i<e->cnt && cnt<n; i++)
+				if (e->from[i]!=w->id)
+					memcpy(reply+(cnt++)*e->size, e->individuals+i*e->size, e->size);
+			i=cnt==0 || send_message(w->conn.fd, MSG_MIGRANTS, reply, cnt*e->size)==0;
+			free(reply);
+			return i;
+		default:
+			return 0;
+	}
+}
+
+void cluster_coordinator(char * address, int table_size) {
+	tWorker workers[CLUSTER_MAX_WORKERS];
+	struct pollfd fds[CLUSTER_MAX_WORKERS+1];
+	tElites elites;
+	int listener, n=0, ids=0, i, fd, type, got, drop;
+	char * payload;
+	size_t len;
+	time_t now;
+
+	if ((listener=open_socket(address, 1)) < 0) {
+		fprintf(stderr, "Coordinator: can't listen at %s\n", address);
+		exit(-1);
+	}
+	elites.table_size=table_size;
+	elites.size=individual_size(table_size);
+	elites.cnt=0;
+	if ((elites.individuals=malloc(CLUSTER_ELITES*elites.size))==NULL) {
+		fprintf(stderr, "Can't allocate memory for the elites!\n");
+		exit(-1);
+	}
+	printf("Coordinator: listening at %s\n", address);
+	while (1) {
+		fds[0].fd=listener;
+		fds[0].events=POLLIN;
+		for (i=0; i<n; i++) {
+			fds[i+1].fd=workers[i].conn.fd;
+			fds[i+1].events=POLLIN;
+		}
+		if (poll(fds, n+1, 1000*CLUSTER_HEARTBEAT) < 0 && errno!=EINTR) {
+			perror("Coordinator: poll");
+			exit(-1);
+		}
+		if ((fds[0].revents & POLLIN) && (fd=accept(listener, NULL, NULL)) >= 0) {
+			if (n==CLUSTER_MAX_WORKERS) close(fd);
+			else {
+				conn_init(&workers[n].conn, fd);
+				workers[n].id=ids++;
+				workers[n].table_size=0;
+				fds[++n].revents=0;
+				printf("Coordinator: worker %d connected\n", workers[n-1].id);
+			}
+		}
+		now=time(NULL);
+		for (i=0; i<n; i++) {
+			drop=fds[i+1].revents && conn_read(&workers[i].conn) < 0;
+			while (!drop && (got=conn_message(&workers[i].conn, &type, &payload, &len))) {
+				if (got < 0 || !handle_message(workers+i, &elites, type, payload, len)) drop=1;
+				else conn_consume(&workers[i].conn, len);
+			}
+			if (!drop && now-workers[i].conn.heard <= CLUSTER_TIMEOUT)
+				continue;
+			printf("Coordinator: worker %d lost\n", workers[i].id);
+			conn_close(&workers[i].conn);
+			workers[i]=workers[--n];
+			fds[i+1]=fds[n+1];
+			i--;
+		}
+	}
+}
+
+/*
+ * the worker
+ */
+static void * network_thread(void * arg) {
+	tCluster * c=arg;
+	struct pollfd pfd={c->conn.fd, POLLIN};
+	char * out=malloc(CLUSTER_BOX*c->individual_size), * payload;
+	time_t beat=time(NULL);
+	int type, got=0, cnt;
+	size_t len, i;
+
+	while (out) {
+		poll(&pfd, 1, 100);
+		if (pfd.revents && conn_read(&c->conn) < 0) break;
+		while ((got=conn_message(&c->conn, &type, &payload, &len)) > 0) {
+			if (type==MSG_MIGRANTS) {	// the inbox keeps the first ones, if they aren't taken in
+				pthread_mutex_lock(&c->lock);
+				for (i=0; i+c->individual_size <= len && c->inbox_cnt < CLUSTER_BOX; i+=c->individual_size) {
+					memcpy(c->inbox+(c->inbox_cnt++)*c->individual_size, payload+i, c->individual_size);
+					c->received++;
+				}
+				pthread_mutex_unlock(&c->lock);
+			}
+			conn_consume(&c->conn, len);
+		}
+		if (got < 0) break;
+		pthread_mutex_lock(&c->lock);
+		memcpy(out, c->outbox, (cnt=c->outbox_cnt)*c->individual_size);
+		c->outbox_cnt=0;
+		pthread_mutex_unlock(&c->lock);
+		if (cnt && send_message(c->conn.fd, MSG_MIGRANTS, out, cnt*c->individual_size)) break;
+		c->sent+=cnt;
+		if (time(NULL)-beat >= CLUSTER_HEARTBEAT) {
+			beat=time(NULL);
+			if (send_message(c->conn.fd, MSG_HEARTBEAT, NULL, 0)) break;
+		}
+		if (time(NULL)-c->conn.heard > CLUSTER_TIMEOUT) break;
+	}
+	printf("Lost the coordinator, evolving alone\n");
+	__atomic_store_n(&c->connected, 0, __ATOMIC_RELEASE);
+	conn_close(&c->conn);
+	free(out);
+	return NULL;
+}
+
+tCluster * cluster_connect(char * address, int table_size) {
+	tCluster * c;
+	uint32_t hello=htonl(table_size);
+	int fd;
+
+	if ((fd=open_socket(address, 0)) < 0)
+		return NULL;
+	if ((c=calloc(1, sizeof(tCluster)))==NULL ||
+			(c->outbox=malloc(CLUSTER_BOX*individual_size(table_size)))==NULL ||
+			(c->inbox=malloc(CLUSTER_BOX*individual_size(table_size)))==NULL) {
+		fprintf(stderr, "Can't allocate memory for the migrants!\n");
+		exit(-1);
+	}
+	conn_init(&c->conn, fd);
+	c->table_size=table_size;
+	c->used_words=USED_WORDS(table_size);
+	c->individual_size=individual_size(table_size);
+	c->connected=1;
+	pthread_mutex_init(&c->lock, NULL);
+	if (send_message(fd, MSG_HELLO, &hello, 4) || pthread_create(&c->thread, NULL, network_thread, c)) {
+		close(fd);
+		return NULL;
+	}
+	return c;
+}
+
+int cluster_send(tCluster * c, tTransTableItem * table, ulong * used, double fitness) {
+	char * s;
+	int ok=0;
+
+	if (!__atomic_load_n(&c->connected, __ATOMIC_ACQUIRE)) return 0;
+	pthread_mutex_lock(&c->lock);
+	if (c->outbox_cnt < CLUSTER_BOX) {
+		s=c->outbox+(c->outbox_cnt++)*c->individual_size;
+		memcpy(s, &fitness, sizeof(double));
+		memcpy(s+sizeof(double), used, c->used_words*sizeof(ulong));
+		memcpy(s+sizeof(double)+c->used_words*sizeof(ulong), table, c->table_size*sizeof(tTransTableItem));
+		ok=1;
+	}
+	pthread_mutex_unlock(&c->lock);
+	return ok;
+}
+
+int cluster_receive(tCluster * c, tTransTableItem * table, ulong * used, double * fitness) {
+	char * s;
+	int ok=0;
+
+	pthread_mutex_lock(&c->lock);
+	if (c->inbox_cnt > 0) {
+		s=c->inbox+(--c->inbox_cnt)*c->individual_size;
+		memcpy(fitness, s, sizeof(double));
+		memcpy(used, s+sizeof(double), c->used_words*sizeof(ulong));
+		memcpy(table, s+sizeof(double)+c->used_words*sizeof(ulong), c->table_size*sizeof(tTransTableItem));
+		ok=1;
+	}
+	pthread_mutex_unlock(&c->lock);
+	return ok;
+}
+
+void cluster_print(tCluster * c, FILE * out) {
+	fprintf(out, "Cluster: %s, migrants sent=%lu, received=%lu\n",
+			c->connected ? "connected" : "coordinator lost", c->sent, c->received);
+}
@@ -0,0 +1,70 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include "turing.h"
+
+#define CLUSTER_HEARTBEAT 1		// seconds between the heartbeats
+#define CLUSTER_TIMEOUT 5		// seconds of silence, after which the peer is given up
+#define CLUSTER_ELITES 64		// the best individuals kept by the coordinator
+#define CLUSTER_MAX_WORKERS 256
+#define CLUSTER_BOX 256			// migrants waiting to be sent or taken in by a worker
+#define CLUSTER_MSG_MAX (16<<20)
+
+/**
+ * Message: 4 bytes payload length (network order), 1 byte type, payload.
+ * MSG_HELLO has the table size (4 bytes, network order), MSG_MIGRANTS any nr. of
+ * individuals as fitness, used bitmap and table in the host order: the pool must be homogeneous.
+ */
+enum {MSG_HELLO, MSG_HEARTBEAT, MSG_MIGRANTS};
+
+typedef struct {
+	int fd;
+	char * buf;			// received bytes, not yet parsed
+	size_t len, cap;
+	time_t heard;		// the last time something came
+} tConnection;
+
+/**
+ * The worker's side: a network thread owns the connection, the evolution threads
+ * only put their migrants into the outbox and take the immigrants from the inbox.
+ */
+typedef struct {
+	tConnection conn;
+	int table_size, used_words, connected;
+	size_t individual_size;
+	pthread_t thread;
+	pthread_mutex_t lock;	// of the boxes
+	char * outbox, * inbox;	// [CLUSTER_BOX] individuals each
+	int outbox_cnt, inbox_cnt;
+	ulong sent, received;
+} tCluster;
+
+extern tCluster * cluster;	// NULL = not a worker
+
+/**
+ * Serves the workers at the address ("host:port" or a Unix socket path with a '/'),
+ * keeps the best individuals they send and answers each migration with as many of them
+ * (from the other workers). Never returns.
+ */
+void cluster_coordinator(char * address, int table_size);
+/**
+ * Connects to the coordinator and starts the network thread.
+ * @return NULL if the coordinator can't be reached
+ */
+tCluster * cluster_connect(char * address, int table_size);
+/**
+ * Queues the individual for the coordinator.
+ * @return 0 if the outbox is full or the coordinator is lost
+ */
+int cluster_send(tCluster * c, tTransTableItem * table, ulong * used, double fitness);
+/**
+ * Takes an immigrant from the coordinator.
+ * @return 0 if there's none
+ */
+int cluster_receive(tCluster * c, tTransTableItem * table, ulong * used, double * fitness);
+void cluster_print(tCluster * c, FILE * out);
+
+#endif
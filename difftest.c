@@ -0,0 +1,317 @@
+/**
+ * Differential test of the engines: seeded random machines and tapes run on each engine
+ * (fast, batch, JIT and the run-length encoded tape, with the sweeps on and off), and resumed
+ * from the checkpoints of a parent's run, the results are compared with turing():
+ * the status, the tape and the used items. The fitness evaluation is compared the same way,
+ * bounded and batch, resumed from the parent's runs, on the flat and the encoded sample tapes.
+ * Short evolutions check, that each individual has the fitness of its table, inherited or evaluated.
+ * Only the loop flag (ERR_LOOP) may differ, where the engine's doc says so.
+ *
+ * gcc -std=gnu99 -fgnu89-inline -O2 -fopenmp difftest.c arena.c checkpoint.c cluster.c dpqueue.c evolve_turing.c \
+ *     fitness_cache.c island.c pqueue.c prng.c results.c snapshot.c stats.c turing.c turing_batch.c turing_jit.c rle_tape.c samples.c \
+ *     -o difftest -lm -lpthread
+ * ./difftest [-n CASES] [-s SEED]
+ * @return 1 if any result differs from turing()
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "common.h"
+#include "turing.h"
+#include "turing_batch.h"
+#include "rle_tape.h"
+#include "checkpoint.h"
+#include "evolve_turing.h"
+#include "samples.h"
+#include "prng.h"
+#include "dpqueue.h"
+#include "snapshot.h"
+
+#define MAX_STATES 16
+#define MAX_SYMBOLS 5
+#define MAX_TABLE (MAX_STATES*MAX_SYMBOLS)
+#define MAX_INPUT_LEN 3000
+#define GROUP_MAX 8			// machines run together by the batch engine, on the same tape
+#define MISMATCHES_SHOWN 10
+#define FITNESS_CASES_DIV 20	// the fitness tests run on every 20th case, they take all the sample tapes
+#define EVOLUTION_SEEDS 20
+#define EVOLUTION_GENERATIONS 3	// the parents' ranks change most at the start
+
+volatile int log_level=LOG_NONE_0;
+
+static char * Engine_names[ENGINES]={"reference", "fast", "batch", "jit"};
+static int Shapes[][2]={{8, 4}, {10, 4}, {12, 4}, {16, 4}, {3, 2}, {5, 3}, {7, 5}};
+static long Runs, Mismatches;
+
+static tTransTableItem random_item(int states, int symbols) {
+	return TRANS_ITEM(prng_below(states+1), (int)prng_below(symbols+1)-1, prng_below(SHIFTS));
+}
+
+// a random table: sometimes rich in sweeps (the items keep the state and the symbol and move)
+static void random_table(tTransTableItem * table, int states, int symbols, int sweepy) {
+	int i;
+
+	for (i=0; i<states*symbols; i++)
+		if (sweepy && prng_below(2))
+			table[i]=TRANS_ITEM(i/symbols, prng_below(2) ? -1 : i%symbols, prng_below(2));
+		else
+			table[i]=random_item(states, symbols);
+}
+
+// a random input between the BLANKs: single cells, or runs of a symbol
+static void random_input(schar * in, int len, int symbols) {
+	int i, run=prng_below(2) ? 1 : 40, r, symbol;
+
+	memset(in, BLANK, len);
+	for (i=1; i<len-1; ) {
+		symbol=prng_below(symbols);
+		for (r=1+prng_below(run); r-- && i<len-1; i++) in[i]=symbol;
+	}
+}
+
+static void start(tTape * work, tTape * orig, tStatus * status) {
+	init_tape(orig, work);
+	memset(status, 0, sizeof(tStatus));
+	status->head=HEAD_START;
+}
+
+static int same_cells(tTape * a, schar * cells, int size) {
+	int i;
+
+	for (i=0; i<a->limit; i++)
+		if ((i<a->size ? a->content[i] : BLANK)!=(i<size ? cells[i] : BLANK)) return 0;
+	return 1;
+}
+
+/**
+ * Counts a mismatch of the run against the reference one, tape NULL = the tape is compared already.
+ * @param loop_flag 1=the runs may differ in ERR_LOOP only
+ */
+static void check(char * what, int seed_case, tStatus * ref, tStatus * status, tTape * ref_tape, tTape * tape,
+		ulong * ref_used, ulong * used, int table_size, int loop_flag) {
+	tStatus a=*ref, b=*status;
+	int same_tape=tape==NULL || (same_cells(ref_tape, tape->content, tape->size) && ref_tape->dirty==tape->dirty);
+
+	Runs++;
+	if (loop_flag && (a.error==ERR_LOOP || b.error==ERR_LOOP)) a.error=b.error=0;
+	if (!memcmp(&a, &b, sizeof(tStatus)) && same_tape && !memcmp(ref_used, used, USED_WORDS(table_size)*sizeof(ulong)))
+		return;
+	if (Mismatches++<MISMATCHES_SHOWN)
+		printf("%s differs in case %d: state %d/%d steps %d/%d writes %d/%d error %d/%d head %d/%d head_max %d/%d%s\n",
+				what, seed_case, ref->state, status->state, ref->steps, status->steps, ref->writes, status->writes,
+				ref->error, status->error, ref->head, status->head, ref->head_max, status->head_max,
+				same_tape ? "" : ", the tape");
+}
+
+// a group of machines on one tape: each engine, the sweeps on and off, the encoded tape and the checkpoints
+static void test_engines(int seed_case) {
+	static tTape orig, ref[GROUP_MAX], work[GROUP_MAX];
+	static tRleTape orig_rle, rle;
+	static schar in[MAX_INPUT_LEN], decoded[TAPE_LIMIT(MAX_INPUT_LEN)];
+	tTransTableItem tables[GROUP_MAX][MAX_TABLE], kid[MAX_TABLE];
+	tTransitions t[GROUP_MAX];
+	tStatus ref_status[GROUP_MAX], status[GROUP_MAX];
+	ulong ref_used[GROUP_MAX][USED_WORDS(MAX_TABLE)], used[GROUP_MAX][USED_WORDS(MAX_TABLE)];
+	tRunCheckpoints c;
+	tEngine e;
+	int n=1+prng_below(GROUP_MAX), len=prng_below(2) ? 3+prng_below(60) : 400+prng_below(MAX_INPUT_LEN-400),
+		max_steps=prng_below(3) ? prng_below(30000) : 300000, *shape=Shapes[prng_below(7)],
+		generic=prng_below(4)==0, states=generic ? 1+prng_below(MAX_STATES) : shape[0],
+		symbols=generic ? 1+prng_below(MAX_SYMBOLS) : shape[1], table_size=states*symbols, k, checkpoint;
+	char what[64];
+
+	loop_check=prng_below(2);
+	random_input(in, len, symbols);
+	orig.content=in;
+	orig.input_len=len;
+	for (k=0; k<n; k++) {
+		random_table(tables[k], states, symbols, prng_below(2));
+		t[k]=(tTransitions){states, symbols, tables[k], ref_used[k]};
+		memset(ref_used[k], 0, sizeof(ref_used[k]));
+		start(ref+k, &orig, ref_status+k);
+		turing(ref+k, t+k, max_steps, ref_status+k);
+	}
+	for (sweeps=0; sweeps<2; sweeps++) {
+		for (e=ENGINE_FAST; e<ENGINES; e++) {
+			set_turing_engine(e, prng_below(4) ? states : 0, symbols);
+			for (k=0; k<n; k++) {
+				t[k].used=used[k];
+				memset(used[k], 0, sizeof(used[k]));
+				start(work+k, &orig, status+k);
+			}
+			if (e==ENGINE_BATCH) turing_batch(work, t, n, max_steps, status);
+			else for (k=0; k<n; k++) turing_engine(work+k, t+k, max_steps, status+k);
+			snprintf(what, sizeof(what), "%s engine, sweeps %d,", Engine_names[e], sweeps);
+			for (k=0; k<n; k++)
+				check(what, seed_case, ref_status+k, status+k, ref+k, work+k, ref_used[k], used[k], table_size,
+						e==ENGINE_JIT);
+		}
+		rle_encode(&orig_rle, in, len);
+		for (k=0; k<n; k++) {
+			rle_copy(&orig_rle, &rle);
+			t[k].used=used[k];
+			memset(used[k], 0, sizeof(used[k]));
+			memset(status+k, 0, sizeof(tStatus));
+			status[k].head=HEAD_START;
+			turing_rle(&rle, t+k, max_steps, status+k);
+			rle_decode(&rle, decoded, ref[k].limit);
+			snprintf(what, sizeof(what), "rle engine, sweeps %d,", sweeps);
+			if (!same_cells(ref+k, decoded, ref[k].limit)) status[k].error=-1;	// counted as a mismatch
+			check(what, seed_case, ref_status+k, status+k, ref+k, NULL, ref_used[k], used[k], table_size, 0);
+		}
+	}
+	// a kid differing from the parent in one item, resumed from the parent's checkpoints
+	set_turing_engine(ENGINE_FAST, states, symbols);
+	checkpoints_init(&c, table_size);
+	for (k=0; k<n; k++) {
+		start(work, &orig, status);
+		turing_checkpoints(work, t+k, max_steps, status, 1+prng_below(2000), &c);
+		memcpy(kid, tables[k], table_size*sizeof(tTransTableItem));
+		kid[prng_below(table_size)]=random_item(states, symbols);
+		t[k].table=kid;
+		t[k].used=ref_used[k];
+		memset(ref_used[k], 0, sizeof(ref_used[k]));
+		start(ref, &orig, ref_status);
+		turing(ref, t+k, max_steps, ref_status);
+		t[k].used=used[k];
+		memset(used[k], 0, sizeof(used[k]));
+		checkpoint=checkpoint_find(&c, tables[k], kid, table_size);
+		if (checkpoint<0)
+			checkpoint_used(&c, c.count, used[k], table_size);	// the parent's run is the kid's
+		else {
+			start(work, &orig, status);
+			checkpoint_restore(&c, checkpoint, work, status, used[k], table_size);
+			turing_engine(work, t+k, max_steps, status);
+		}
+		check("checkpoint resume", seed_case, ref_status, status, ref, work, ref_used[k], used[k], table_size, 1);
+	}
+	checkpoints_free(&c);
+	sweeps=1;
+}
+
+static void check_fitness(char * what, int seed_case, double ref, double fitness, ulong * ref_used, ulong * used,
+		int table_size) {
+	Runs++;
+	// the items read by a failed machine depend on the order of the tapes, see eval_cached()
+	if (ref==fitness && (ref==-1 || !memcmp(ref_used, used, USED_WORDS(table_size)*sizeof(ulong)))) return;
+	if (Mismatches++<MISMATCHES_SHOWN)
+		printf("%s differs in case %d: fitness %.9lf/%.9lf%s\n", what, seed_case, ref, fitness,
+				ref==fitness ? ", the used items" : "");
+}
+
+/**
+ * The kids of demoBubble or of a random parent on the sample tapes: the plain evaluation
+ * against the bounded and the batch one, resumed from the parent's runs, and on the encoded tapes
+ */
+static void test_fitness(int seed_case) {
+	int symbols=demoBubble.symbols, states=demoBubble.states, table_size=states*symbols, i, k, n=GROUP_MAX;
+	tParams params={.states=states, .symbols=symbols, .checkpoint_interval=1+prng_below(2000)};
+	tTransTableItem parent[MAX_TABLE], kids[GROUP_MAX][MAX_TABLE];
+	tTransitions t[GROUP_MAX];
+	tParentRun * runs=get_parent_runs(1, &params, NR_OF_SAMPLE_TAPES), * parents[GROUP_MAX];
+	ulong ref_used[GROUP_MAX][USED_WORDS(MAX_TABLE)], used[GROUP_MAX][USED_WORDS(MAX_TABLE)];
+	double ref[GROUP_MAX], fitness[GROUP_MAX];
+
+	loop_check=prng_below(2);
+	set_turing_engine(ENGINE_FAST, states, symbols);
+	if (prng_below(2)) memcpy(parent, demoBubble.table, table_size*sizeof(tTransTableItem));
+	else random_table(parent, states, symbols, prng_below(2));
+	record_parent_run(runs, parent, &params, Sample_tapes, NR_OF_SAMPLE_TAPES);
+	for (k=0; k<n; k++) {
+		memcpy(kids[k], parent, table_size*sizeof(tTransTableItem));
+		for (i=prng_below(3); i>=0; i--) kids[k][prng_below(table_size)]=random_item(states, symbols);
+		t[k]=(tTransitions){states, symbols, kids[k], ref_used[k]};
+		reset_used(t+k, 0);
+		ref[k]=eval_sorting_fitness_n_tapes(t+k, Sample_tapes, NR_OF_SAMPLE_TAPES);
+		t[k].used=used[k];
+		reset_used(t+k, 0);
+		fitness[k]=eval_sorting_fitness_bounded(t+k, runs, Sample_tapes, NR_OF_SAMPLE_TAPES, NO_THRESHOLD);
+		check_fitness("bounded fitness, resumed,", seed_case, ref[k], fitness[k], ref_used[k], used[k], table_size);
+		parents[k]=runs;
+		reset_used(t+k, 0);
+	}
+	eval_sorting_fitness_batch(t, n, Sample_tapes, NR_OF_SAMPLE_TAPES, parents, NO_THRESHOLD, fitness);
+	for (k=0; k<n; k++)
+		check_fitness("batch fitness, resumed,", seed_case, ref[k], fitness[k], ref_used[k], used[k], table_size);
+	set_rle_tapes(Sample_tapes, NR_OF_SAMPLE_TAPES, 1);
+	for (k=0; k<n; k++) {
+		reset_used(t+k, 0);
+		fitness[k]=eval_sorting_fitness_n_tapes(t+k, Sample_tapes, NR_OF_SAMPLE_TAPES);
+		check_fitness("fitness on the encoded tapes", seed_case, ref[k], fitness[k], ref_used[k], used[k], table_size);
+	}
+	set_rle_tapes(Sample_tapes, NR_OF_SAMPLE_TAPES, 0);
+}
+
+/**
+ * Short evolutions of populations, which are not much bigger than their parents, so a kid often
+ * replaces its parent or a sibling's parent: the fitness of each individual in the final
+ * snapshot must be the one of its table, inherited or evaluated
+ */
+static void test_evolution(int seed) {
+	// population, best, kids, the engine
+	int runs[][4]={{10, 10, 30, ENGINE_FAST}, {20, 20, 10, ENGINE_FAST}, {20, 12, 5, ENGINE_FAST},
+			{10, 10, 30, ENGINE_BATCH}};
+	char output[]="/tmp/difftest-XXXXXX", path[PATH_MAX], what[64];
+	tParams params;
+	tPopulation population;
+	dpqueue_t * pqueue;
+	ulong generation, last_success_generation, restarts;
+	ulong used[USED_WORDS(12*SAMPLE_TAPE_SYMBOLS)];
+	tTransitions t={12, SAMPLE_TAPE_SYMBOLS, NULL, used};
+	double fitness;
+	int r, s, g, i;
+
+	if (mkdtemp(output)==NULL) {
+		fprintf(stderr, "Can't create the output directory of the evolution!\n");
+		exit(-1);
+	}
+	set_kernels(t.states, t.symbols);
+	for (r=0; r<sizeof(runs)/sizeof(runs[0]); r++)
+		for (s=seed; s<seed+EVOLUTION_SEEDS; s++)
+			for (g=1; g<=EVOLUTION_GENERATIONS; g++) {	// the same seeded run, stopped after each generation
+				params=(tParams){.population_size=runs[r][0], .states=t.states, .symbols=t.symbols,
+						.best_cnt=runs[r][1], .kids_cnt=runs[r][2], .degeneration_cnt=1000, .output=output,
+						.engine=runs[r][3], .seed=s, .snapshot_interval=SNAPSHOT_DEFAULT_INTERVAL, .generations=g};
+				set_turing_engine(params.engine, params.states, params.symbols);
+				evolve_turing(&params, Sample_tapes, NR_OF_SAMPLE_TAPES);
+				pqueue=dpqueue_init(params.population_size);
+				snapshot_load(&params, 0, &population, pqueue, &generation, &last_success_generation, &restarts);
+				snprintf(what, sizeof(what), "fitness in the evolution %d, seed %d, generation %d,", r, s, g);
+				for (i=0; i<population.size; i++) {
+					t.table=POPULATION_TABLE(&population, i);
+					fitness=eval_sorting_fitness_n_tapes(&t, Sample_tapes, NR_OF_SAMPLE_TAPES);
+					check_fitness(what, i, fitness, population.fitness[i], used, used, t.states*t.symbols);
+				}
+				dpqueue_free(pqueue);
+			}
+	snprintf(path, sizeof(path), "%s/state-0.bin", output);
+	unlink(path);
+	rmdir(output);
+}
+
+int main(int argc, char ** argv) {
+	tTapeMetrics metrics[NR_OF_SAMPLE_TAPES];
+	int cases=2000, seed=1, i;
+
+	for (i=1; i+1<argc; i+=2) {
+		if (!strcmp(argv[i], "-n")) cases=atoi(argv[i+1]);
+		else if (!strcmp(argv[i], "-s")) seed=atoi(argv[i+1]);
+		else break;
+	}
+	if (i<argc || cases<1) {
+		fprintf(stderr, "%s [-n CASES] [-s SEED]\n"
+				"-n CASES\n	random groups of machines, each on its own tape. Default is 2000\n"
+				"-s SEED\n	of the machines and the tapes. Default is 1\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	calc_all_tapes_metrics(Sample_tapes, metrics, NR_OF_SAMPLE_TAPES);
+	for (i=0; i<cases; i++) {
+		prng_seed((ulong)seed<<32 | i, 0);	// each case can be repeated alone
+		test_engines(i);
+		if (i%FITNESS_CASES_DIV==0) test_fitness(i);
+	}
+	test_evolution(seed);
+	printf("%ld runs, %ld mismatches\n", Runs, Mismatches);
+	return Mismatches ? 1 : EXIT_SUCCESS;
+}
@@ -0,0 +1,214 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "dpqueue.h"
+
+#define node(x)		(q->nodes+(x))
+#define size(x)		(q->nodes[x].size)
+
+// a ranks higher than b: better fitness, or the same fitness and older
+static int ranks_before(dpqueue_t * q, int a, int b) {
+	double fa=node(a)->fitness, fb=node(b)->fitness;
+	return fa > fb || (fa == fb && node(a)->seq < node(b)->seq);
+}
+
+static inline void update(dpqueue_t * q, int x) {
+	node(x)->size=1 + size(node(x)->left) + size(node(x)->right);
+}
+
+// joins the trees a and b, all of a rank before all of b
+static int merge(dpqueue_t * q, int a, int b) {
+	if (!a) return b;
+	if (!b) return a;
+	if (node(a)->prio > node(b)->prio) {
+		node(a)->right=merge(q, node(a)->right, b);
+		update(q, a);
+		return a;
+	}
+	node(b)->left=merge(q, a, node(b)->left);
+	update(q, b);
+	return b;
+}
+
+// splits the tree t to the items ranking before the node x (l) and the rest (r)
+static void split_node(dpqueue_t * q, int t, int x, int * l, int * r) {
+	if (!t) {
+		*l=*r=0;
+		return;
+	}
+	if (ranks_before(q, t, x)) {
+		split_node(q, node(t)->right, x, &node(t)->right, r);
+		*l=t;
+	} else {
+		split_node(q, node(t)->left, x, l, &node(t)->left);
+		*r=t;
+	}
+	update(q, t);
+}
+
+// inserts the node x into the tree t, adds the nr. of items ranking before it to rank, @return the new tree
+static int insert_into(dpqueue_t * q, int t, int x, int * rank) {
+	if (!t) return x;
+	if (node(x)->prio > node(t)->prio) {
+		split_node(q, t, x, &node(x)->left, &node(x)->right);
+		update(q, x);
+		*rank+=size(node(x)->left);
+		return x;
+	}
+	node(t)->size++;
+	if (ranks_before(q, x, t))
+		node(t)->left=insert_into(q, node(t)->left, x, rank);
+	else {
+		*rank+=size(node(t)->left)+1;
+		node(t)->right=insert_into(q, node(t)->right, x, rank);
+	}
+	return t;
+}
+
+// removes the item of rank i from the tree t, its node goes to x, @return the new tree
+static int remove_from(dpqueue_t * q, int t, int i, int * x) {
+	if (i == size(node(t)->left)+1) {
+		*x=t;
+		return merge(q, node(t)->left, node(t)->right);
+	}
+	node(t)->size--;
+	if (i <= size(node(t)->left))
+		node(t)->left=remove_from(q, node(t)->left, i, x);
+	else
+		node(t)->right=remove_from(q, node(t)->right, i-size(node(t)->left)-1, x);
+	return t;
+}
+
+// the ends of the tree, after a change of them
+static void update_ends(dpqueue_t * q) {
+	int x;
+
+	for (x=q->root; x && node(x)->left; x=node(x)->left);
+	q->best=x;
+	for (x=q->root; x && node(x)->right; x=node(x)->right);
+	q->worst=x;
+}
+
+static unsigned next_random(dpqueue_t * q) {
+	q->random^=q->random << 13;
+	q->random^=q->random >> 17;
+	q->random^=q->random << 5;
+	return q->random;
+}
+
+// inserts the node x of the given fitness, @return its rank
+static int insert_node(dpqueue_t * q, int x, double fitness) {
+	int rank=1;
+
+	node(x)->fitness=fitness;
+	node(x)->seq=q->seq++;
+	node(x)->left=node(x)->right=0;
+	node(x)->size=1;
+	q->root=insert_into(q, q->root, x, &rank);
+	if (rank==1) q->best=x;
+	if (rank==q->size) q->worst=x;
+	return rank;
+}
+
+dpqueue_t * dpqueue_init(int n) {
+	dpqueue_t * q;
+
+	if (!(q=malloc(sizeof(dpqueue_t))))
+		return NULL;
+	if (!(q->nodes=calloc(n+1, sizeof(tDpqNode)))) {
+		free(q);
+		return NULL;
+	}
+	q->avail=n+1;
+	q->random=2463534242U;
+	q->attached=0;
+	dpqueue_reset(q);
+	return q;
+}
+
+void dpqueue_free(dpqueue_t * q) {
+	if (!q->attached) free(q->nodes);
+	free(q);
+}
+
+void dpqueue_attach(dpqueue_t * q, dpqueue_t * saved, tDpqNode * nodes) {
+	if (!q->attached) free(q->nodes);
+	*q=*saved;
+	q->nodes=nodes;
+	q->attached=1;
+}
+
+inline int dpqueue_size(dpqueue_t * q) {
+	return q->size;
+}
+
+void dpqueue_reset(dpqueue_t * q) {
+	q->root=q->best=q->worst=0;
+	q->size=0;
+	q->seq=0;
+}
+
+int dpqueue_insert(dpqueue_t * q, int item, double fitness) {
+	int x=q->size+1;
+
+	if (x >= q->avail) {
+		fprintf(stderr, "Unexpected need for queue growth!\n");
+		exit(-1);
+	}
+	q->size++;
+	node(x)->item=item;
+	node(x)->prio=next_random(q);
+	return insert_node(q, x, fitness);
+}
+
+int dpqueue_get(dpqueue_t * q, int i) {
+	int x=q->root;
+
+	if (i<1 || i>q->size) return -1;
+	if (i==1) return node(q->best)->item;
+	if (i==q->size) return node(q->worst)->item;
+	while (i != size(node(x)->left)+1)
+		if (i <= size(node(x)->left))
+			x=node(x)->left;
+		else {
+			i-=size(node(x)->left)+1;
+			x=node(x)->right;
+		}
+	return node(x)->item;
+}
+
+int dpqueue_priority_changed(dpqueue_t * q, int i, double fitness) {
+	int x;
+
+	if (i<1 || i>q->size) {
+		fprintf(stderr, "No item of rank %d in the queue!\n", i);
+		exit(-1);
+	}
+	// take the item out by its rank, its fitness doesn't fit the order now
+	q->root=remove_from(q, q->root, i, &x);
+	if (x==q->best || x==q->worst) update_ends(q);
+	return insert_node(q, x, fitness);
+}
+
+static int subtree_is_valid(dpqueue_t * q, int x, int * first, int * last) {
+	int l_first, l_last, r_first, r_last;
+	tDpqNode * n=node(x);
+
+	if (n->left && (node(n->left)->prio > n->prio || !subtree_is_valid(q, n->left, &l_first, &l_last) ||
+			!ranks_before(q, l_last, x)))
+		return 0;
+	if (n->right && (node(n->right)->prio > n->prio || !subtree_is_valid(q, n->right, &r_first, &r_last) ||
+			!ranks_before(q, x, r_first)))
+		return 0;
+	*first=n->left ? l_first : x;
+	*last=n->right ? r_last : x;
+	return n->size == 1 + size(n->left) + size(n->right);
+}
+
+int dpqueue_is_valid(dpqueue_t * q) {
+	int first, last;
+
+	if (!q->root) return q->size==0;
+	return subtree_is_valid(q, q->root, &first, &last) && size(q->root)==q->size &&
+		first==q->best && last==q->worst;
+}
@@ -0,0 +1,88 @@
+/**
+ * @file  dpqueue.h
+ * @brief Double-ended priority queue of population indices with rank queries,
+ * implemented by an order statistic treap (a randomized binary search tree
+ * whose nodes know the sizes of their subtrees).
+ *
+ * The items are ranked by their fitness, the best one has the rank 1,
+ * the worst one has the rank dpqueue_size(). Of two items with the same fitness,
+ * the one inserted (or changed) earlier ranks higher.
+ * Best and worst are O(1), the rest is O(log n).
+ *
+ * @{
+ */
+
+#ifndef DPQUEUE_H
+#define DPQUEUE_H
+#include "turing.h"
+
+typedef struct {
+	int item;			/**< index into the population */
+	double fitness;		/**< the item's fitness, the queue doesn't look into the population */
+	ulong seq;			/**< insertion order, for the items of equal fitness */
+	unsigned prio;		/**< random treap priority, a parent's is higher than its children's */
+	int left, right, size;
+} tDpqNode;
+
+/** @struct dpqueue_t
+ * the queue handle
+ */
+typedef struct {
+	tDpqNode * nodes;	/**< nodes[0] is the empty tree */
+	int root;
+	int size, avail;	/**< nr. of items, nr. of nodes allocated */
+	int best, worst;	/**< nodes of rank 1 and size */
+	ulong seq;
+	unsigned random;
+	int attached;		/**< the nodes aren't the queue's own, see dpqueue_attach() */
+} dpqueue_t;
+
+/**
+ * initialize the queue
+ * @param n the maximal number of queue items
+ * @return the handle or NULL for insufficient memory
+ */
+dpqueue_t * dpqueue_init(int n);
+
+void dpqueue_free(dpqueue_t * q);
+
+/**
+ * Replaces the queue by a saved copy of a queue of the same size, whose nodes are
+ * at the given memory (a mapped file). The nodes stay the caller's to free.
+ */
+void dpqueue_attach(dpqueue_t * q, dpqueue_t * saved, tDpqNode * nodes);
+
+inline int dpqueue_size(dpqueue_t * q);
+
+/**
+ * Resets the queue to initial (empty) state.
+ */
+void dpqueue_reset(dpqueue_t * q);
+
+/**
+ * insert an item into the queue.
+ * @return the rank of the item
+ */
+int dpqueue_insert(dpqueue_t * q, int item, double fitness);
+
+/**
+ * access the item of the rank i (without removing it).
+ * @param i the rank. Warning: the best item has i=1, the worst item has i=dpqueue_size()
+ * @return -1 if there's no such rank, otherwise the item
+ */
+int dpqueue_get(dpqueue_t * q, int i);
+
+/**
+ * Moves the item of the rank i to the rank of its new fitness.
+ * @return the new rank of the item
+ */
+int dpqueue_priority_changed(dpqueue_t * q, int i, double fitness);
+
+/**
+ * checks the order, the sizes and the treap priorities
+ * @return 1 if the queue is valid
+ */
+int dpqueue_is_valid(dpqueue_t * q);
+
+#endif /* DPQUEUE_H */
+/** @} */
@@ -5,16 +5,46 @@
 #include <time.h>
 #include <omp.h>
 #include "turing.h"
+#include "turing_batch.h"
 #include "evolve_turing.h"
-#include "pqueue.h"
+#include "dpqueue.h"
+#include "fitness_cache.h"
+#include "prng.h"
+#include "island.h"
+#include "cluster.h"
+#include "stats.h"
+#include "snapshot.h"
+#include "results.h"
 #include "common.h"
 
 tTransTableItem * Pregen_tuples;
 int Pregen_tuples_cnt;
 #pragma omp threadprivate(Pregen_tuples, Pregen_tuples_cnt)
+tParentRun * Parent_runs;	// the recorded runs of the current parents
+int Parent_runs_cnt;
+#pragma omp threadprivate(Parent_runs, Parent_runs_cnt)
+int * Tape_order, Tape_cnt;	// see tape_order()
+double * Tape_gain;
+#pragma omp threadprivate(Tape_order, Tape_cnt, Tape_gain)
+tTape * Work_tapes;	// see work_tapes()
+int Work_tapes_cnt;
+#pragma omp threadprivate(Work_tapes, Work_tapes_cnt)
+tGenomeHash Genome_hash=genome_hash;	// of the run's shape, see set_kernels()
+tRleTape * Rle_tapes;	// run-length encoded sample tapes, see set_rle_tapes()
+int Rle_tapes_cnt;
+tRleTape Rle_work;
+#pragma omp threadprivate(Rle_work)
+// the sample tape nr. i runs on its run-length encoded copy
+#define RLE_TAPE(i) ((i) < Rle_tapes_cnt && Rle_tapes[i].count)
+int Screen_pass, Screen_steps, Screen_tape;	// see set_screening()
+double Screen_scores[SCREEN_WINDOW], Screen_threshold;	// the last scores, in a ring
+int Screen_cnt;
+#pragma omp threadprivate(Screen_scores, Screen_threshold, Screen_cnt)
 
+// bounded, so that steps+writes fit into an int
 inline int get_max_steps(int input_len) {
-	return input_len*input_len*input_len;
+	long steps=(long)input_len*input_len*input_len;
+	return steps < INT_MAX/2 ? steps : INT_MAX/2;
 }
 
 void calc_tape_metrics(tTape * tape, tTapeMetrics *metrics) {
@@ -36,6 +66,23 @@ void calc_tape_metrics(tTape * tape, tTapeMetrics *metrics) {
 	tape->metrics=metrics;
 }
 
+void calc_rle_tape_metrics(tRleTape * tape, tTapeMetrics * metrics) {
+	int symbols=sizeof(metrics->symbol_count)/sizeof(*(metrics->symbol_count));
+	int i, pos, from, to, prev=-1;
+
+	for (i=0; i<symbols; i++) metrics->symbol_count[i]=0;
+	metrics->correct_order=0;
+	// the cells from 1 to input_len-1, like calc_tape_metrics(): a run is ordered inside
+	for (i=tape->first, pos=0; i>=0 && pos<tape->input_len; pos+=tape->blocks[i].len, i=tape->blocks[i].next) {
+		from=pos<1 ? 1 : pos;
+		to=pos+tape->blocks[i].len < tape->input_len ? pos+tape->blocks[i].len : tape->input_len;
+		if (from>=to) continue;
+		metrics->symbol_count[tape->blocks[i].symbol]+=to-from;
+		metrics->correct_order+=to-from-1 + (prev>=0 && tape->blocks[i].symbol >= prev);
+		prev=tape->blocks[i].symbol;
+	}
+}
+
 void calc_all_tapes_metrics(tTape * tapes, tTapeMetrics * metrics, int n) {
 	tTape * tape=tapes;
 	tTapeMetrics * metric=metrics;
@@ -45,11 +92,31 @@ void calc_all_tapes_metrics(tTape * tapes, tTapeMetrics * metrics, int n) {
 	}
 }
 
+/**
+ * @return n work tapes of the current thread, their cells are kept for the next calls,
+ * 		   so that init_tape() only clears what the previous machines wrote
+ */
+tTape * work_tapes(int n) {
+	if (n > Work_tapes_cnt) {
+		if ((Work_tapes=realloc(Work_tapes, n*sizeof(tTape)))==NULL) {
+			fprintf(stderr, "Can't allocate memory for the tapes!\n");
+			exit(-1);
+		}
+		memset(Work_tapes+Work_tapes_cnt, 0, (n-Work_tapes_cnt)*sizeof(tTape));
+		Work_tapes_cnt=n;
+	}
+	return Work_tapes;
+}
+
 inline void init_tape(tTape * orig_tape, tTape * work_tape) {
 	int len=orig_tape->input_len;
+	work_tape->input_len=len;
+	work_tape->limit=TAPE_LIMIT(len);
+	tape_reserve(work_tape, len);
 	memcpy(work_tape->content, orig_tape->content, len);
-	memset(work_tape->content+len, BLANK, TAPE_LEN-len);
-	work_tape->input_len=orig_tape->input_len;
+	if (work_tape->dirty > len)
+		memset(work_tape->content+len, BLANK, work_tape->dirty-len);
+	work_tape->dirty=len;
 }
 
 
@@ -67,36 +134,25 @@ void init_evolution(int states, int symbols) {
 	for (shift=0; shift<SHIFTS; shift++)
 		for (symbol=-1; symbol<symbols; symbol++)
 			for (state=0; state<=states; state++) {
-				Pregen_tuples[i].state=state;
-				Pregen_tuples[i].symbol=symbol;
-				Pregen_tuples[i++].shift=shift;
+				Pregen_tuples[i++]=TRANS_ITEM(state, symbol, shift);
 			}
 }
 
-double eval_sorting_fitness(tTransitions * t, tTape * tape, tTapeMetrics * orig_metrics) {
-	/**
-	 * first, we measure the number of correctly ordered pairs
-	 * and compare the count of the distinct symbols with the original.
-	 * Then we calculate the fitness from these 2 numbers + nr. of steps and new_symbols written
-	 */
-	tStatus status = { 0, 0, 0, 0, 0};
-	tTapeMetrics new_metrics;
-	int i, correct_count, orig_unordered_cnt, delta_ordered_cnt, max_steps;
+// sorting_fitness() of the final tape of input_len cells with the new_metrics, of a run up to max_steps
+static double sorting_fitness_metrics(tTapeMetrics * new_metrics, int input_len, int max_steps, tStatus * status,
+		tTapeMetrics * orig_metrics, int symbols) {
+	int i, correct_count, orig_unordered_cnt, delta_ordered_cnt;
 	double fit_correct, fit_time, fit_space; 
-	// init of the symbol frequency counter
-
-	max_steps=get_max_steps(tape->input_len);
-	turing(tape, t, max_steps, &status);
 
 	/* for completely wrong results, there is no need to calculate fitness...
-	if (status.error<0) return -1;
+	if (status->error<0) return -1;
 	 */
-	calc_tape_metrics(tape, &new_metrics);
-	for (i=0, correct_count=0; i<t->symbols; i++) 
-		if (orig_metrics->symbol_count[i]==new_metrics.symbol_count[i]) correct_count++;
+	stats_run(stats, status, max_steps);
+	for (i=0, correct_count=0; i<symbols; i++) 
+		if (orig_metrics->symbol_count[i]==new_metrics->symbol_count[i]) correct_count++;
 
-	orig_unordered_cnt=tape->input_len-orig_metrics->correct_order-2-1; // -2=two BLANKs, -1 = usual "magic 1" 
-	delta_ordered_cnt=new_metrics.correct_order - orig_metrics->correct_order;
+	orig_unordered_cnt=input_len-orig_metrics->correct_order-2-1; // -2=two BLANKs, -1 = usual "magic 1" 
+	delta_ordered_cnt=new_metrics->correct_order - orig_metrics->correct_order;
 	if (orig_unordered_cnt<1) {
 		orig_unordered_cnt=1; //can't divide by 0
 		if (delta_ordered_cnt>=0) delta_ordered_cnt=1;
@@ -104,9 +160,9 @@ double eval_sorting_fitness(tTransitions * t, tTape * tape, tTapeMetrics * orig_
 	/**
 	 * Correctness = 0.5*Correct_symbol_count + 0.5*Delta_of_correctly_ordered_pairs  
 	 */ 
-	fit_correct=((double)correct_count/t->symbols + (double)delta_ordered_cnt/orig_unordered_cnt)/2;
-	fit_time=1-(double)(status.steps + status.writes)/(2*max_steps);
-	fit_space=1-(double)(2+status.head_max-tape->input_len)/(2+TAPE_LEN-tape->input_len);
+	fit_correct=((double)correct_count/symbols + (double)delta_ordered_cnt/orig_unordered_cnt)/2;
+	fit_time=1-(double)(status->steps + status->writes)/(2*max_steps);
+	fit_space=1-(double)(2+status->head_max-input_len)/(2+TAPE_LIMIT(input_len)-input_len);
 	if (log_level>=LOG_DEBUG_3) {
 		printf("Fitness: correctness=%.2lf, time complexity=%.2lf, space complexity=%.2lf\n",
 				fit_correct, fit_time, fit_space);
@@ -115,55 +171,558 @@ double eval_sorting_fitness(tTransitions * t, tTape * tape, tTapeMetrics * orig_
 			 
 }
 
+double sorting_fitness(tTape * tape, tStatus * status, tTapeMetrics * orig_metrics, int symbols) {
+	/**
+	 * first, we measure the number of correctly ordered pairs
+	 * and compare the count of the distinct symbols with the original.
+	 * Then we calculate the fitness from these 2 numbers + nr. of steps and new_symbols written
+	 */
+	tTapeMetrics new_metrics;
+
+	calc_tape_metrics(tape, &new_metrics);
+	return sorting_fitness_metrics(&new_metrics, tape->input_len, get_max_steps(tape->input_len), status,
+			orig_metrics, symbols);
+}
+
+void set_rle_tapes(tTape * orig_tapes, int n, int min_len) {
+	int i;
+
+	if ((Rle_tapes=realloc(Rle_tapes, n*sizeof(tRleTape)))==NULL) {
+		fprintf(stderr, "Can't allocate memory for the tapes!\n");
+		exit(-1);
+	}
+	memset(Rle_tapes, 0, n*sizeof(tRleTape));
+	Rle_tapes_cnt=n;
+	for (i=0; i<n; i++)
+		if (min_len>0 && orig_tapes[i].input_len >= min_len)
+			rle_encode(Rle_tapes+i, orig_tapes[i].content, orig_tapes[i].input_len);
+}
+
+// the run of the machine from the start on the run-length encoded sample tape nr. i
+static double eval_rle(tTransitions * t, int i, tTapeMetrics * orig_metrics, tStatus * status) {
+	tTapeMetrics new_metrics;
 
-double eval_sorting_fitness_n_tapes(tTransitions * t, tTape * orig_tapes, int n, char * tape_log) {
-	tTape  work_tapes[n],
-		 * work_tape=work_tapes, * orig_tape=orig_tapes;
-	char * tape_log_start=tape_log;
+	memset(status, 0, sizeof(tStatus));
+	status->head=HEAD_START;
+	rle_copy(Rle_tapes+i, &Rle_work);
+	turing_rle(&Rle_work, t, get_max_steps(Rle_work.input_len), status);
+	calc_rle_tape_metrics(&Rle_work, &new_metrics);
+	return sorting_fitness_metrics(&new_metrics, Rle_work.input_len, get_max_steps(Rle_work.input_len), status,
+			orig_metrics, t->symbols);
+}
+
+double eval_sorting_fitness(tTransitions * t, tTape * tape, tTapeMetrics * orig_metrics) {
+	tStatus status = { 0, 0, 0, 0, 0, HEAD_START};
+
+	turing_engine(tape, t, get_max_steps(tape->input_len), &status);
+	return sorting_fitness(tape, &status, orig_metrics, t->symbols);
+}
+
+double eval_sorting_fitness_n_tapes(tTransitions * t, tTape * orig_tapes, int n) {
+	tTape * work_tape=work_tapes(n), * orig_tape=orig_tapes;
+	tStatus status;
 	double fitness, result=0;
-	int i, j;
+	int i;
 	for (i=0; i<n; i++, orig_tape++, work_tape++) {
-		init_tape(orig_tape, work_tape);
-		fitness=eval_sorting_fitness(t, work_tape, orig_tape->metrics);
+		if (RLE_TAPE(i))
+			fitness=eval_rle(t, i, orig_tape->metrics, &status);
+		else {
+			init_tape(orig_tape, work_tape);
+			fitness=eval_sorting_fitness(t, work_tape, orig_tape->metrics);
+		}
 		if (fitness<0) return -1;
 		else result+=fitness;
+	}
+	if (log_level>=LOG_ALL_2) printf("Fitness sum=%.2lf\n", result);	
+	return result;
+}
 
-		for (j=0; j<work_tape->input_len; j++)
-			if (tape_log < tape_log_start + TAPE_LOG_SIZE - 10)
-				tape_log+=sprintf(tape_log, "%d,", work_tape->content[j]);
+// appends the section of the tape to the trace, see tTraceTape
+static void trace_write(FILE * trace, tTape * orig_tape, tTape * work_tape, tStatus * status,
+		double fitness, tTraceStep * steps) {
+	tTraceTape section={orig_tape->input_len, status->steps};
 
-		tape_log+=sprintf(tape_log, "\n");
+	fwrite(&section, sizeof(section), 1, trace);
+	fwrite(orig_tape->content, 1, orig_tape->input_len, trace);
+	fwrite(steps, sizeof(tTraceStep), status->steps, trace);
+	fwrite(status, sizeof(tStatus), 1, trace);
+	fwrite(&fitness, sizeof(double), 1, trace);
+	fwrite(work_tape->content, 1, orig_tape->input_len, trace);
+}
 
-		if (log_level>=LOG_ALL_2)
-			puts(tape_log_start);
+double replay(tTransitions * t, tTape * orig_tape, tTape * work_tape, FILE * trace) {
+	tStatus status={0, 0, 0, 0, 0, HEAD_START};
+	int max_steps=get_max_steps(orig_tape->input_len), capacity=0;
+	tTraceStep * steps=NULL;
+	double fitness;
 
+	init_tape(orig_tape, work_tape);
+	// one step per call: the loop detection never skips any
+	while (status.steps < max_steps && status.state < t->states && status.error!=ERR_BOUNDS) {
+		if (trace) {
+			if (status.steps==capacity) {
+				capacity=capacity ? 2*capacity : 1024;
+				if ((steps=realloc(steps, capacity*sizeof(tTraceStep)))==NULL) {
+					fprintf(stderr, "Can't allocate memory for the trace!\n");
+					exit(-1);
+				}
+			}
+			steps[status.steps].state=status.state;
+			steps[status.steps].symbol=work_tape->content[status.head];
+			steps[status.steps].head=status.head;
+		}
+		turing(work_tape, t, status.steps+1, &status);
 	}
-	if (log_level>=LOG_ALL_2) printf("Fitness sum=%.2lf\n", result);	
-	return result;
+	fitness=sorting_fitness(work_tape, &status, orig_tape->metrics, t->symbols);
+	if (trace) trace_write(trace, orig_tape, work_tape, &status, fitness, steps);
+	free(steps);
+	return fitness;
 }
 
+/**
+ * @return the recorded runs of n parents for the current thread, their valid flags are reset
+ */
+tParentRun * get_parent_runs(int n, tParams * params, int nr_of_tapes) {
+	int i, j, table_size=params->states*params->symbols;
+	tParentRun * p;
 
-unsigned long seed;
-void generate_population(tTransTableItem * population, tIndividual * population_fitness,
-					 tParams * params) {
-	int i, st, sy;
-	tTransTableItem * individual, * transition;
-	tTransitions trans={params->states, params->symbols};
+	if (n > Parent_runs_cnt) {
+		if ((Parent_runs=realloc(Parent_runs, n*sizeof(tParentRun)))==NULL) {
+			fprintf(stderr, "Can't allocate memory for the checkpoints!\n");
+			exit(-1);
+		}
+		for (i=Parent_runs_cnt; i<n; i++) {
+			p=Parent_runs+i;
+			p->table=malloc(table_size*sizeof(tTransTableItem));
+			p->runs=malloc(nr_of_tapes*sizeof(tRunCheckpoints));
+			p->fitness=malloc(nr_of_tapes*sizeof(double));
+			if (p->table==NULL || p->runs==NULL || p->fitness==NULL) {
+				fprintf(stderr, "Can't allocate memory for the checkpoints!\n");
+				exit(-1);
+			}
+			for (j=0; j<nr_of_tapes; j++) checkpoints_init(p->runs+j, table_size);
+		}
+		Parent_runs_cnt=n;
+	}
+	for (i=0; i<n; i++) Parent_runs[i].valid=0;
+	return Parent_runs;
+}
 
-	#pragma omp atomic
-	seed+=10000;
+// records the runs of the parent's table on all the sample tapes, with checkpoints
+void record_parent_run(tParentRun * p, tTransTableItem * parent, tParams * params, tTape * orig_tapes, int n) {
+	tTransitions t={params->states, params->symbols, parent};
+	tTape * work_tape=work_tapes(1);
+	tStatus status;
+	int i;
+
+	memcpy(p->table, parent, params->states*params->symbols*sizeof(tTransTableItem));
+	for (i=0; i<n; i++) {
+		if (RLE_TAPE(i)) continue;		// the kids run from the start there
+		init_tape(orig_tapes+i, work_tape);
+		memset(&status, 0, sizeof(tStatus));
+		status.head=HEAD_START;
+		turing_checkpoints(work_tape, &t, get_max_steps(orig_tapes[i].input_len), &status,
+				params->checkpoint_interval, p->runs+i);
+		p->fitness[i]=sorting_fitness(work_tape, &status, orig_tapes[i].metrics, t.symbols);
+	}
+	p->valid=1;
+}
 
-	srand (seed+time(NULL));
+/**
+ * Prepares the run of the machine t on the sample tape nr. i from the parent's last checkpoint
+ * before the first use of a transition, where the machine differs from the parent.
+ * @return 1 if the machine has to run, 0 if it behaves like the parent: fitness is the parent's then
+ */
+int resume_parent_run(tParentRun * p, int i, tTransitions * t, tTape * orig_tape,
+		tTape * work_tape, tStatus * status, double * fitness) {
+	int table_size=t->states*t->symbols, checkpoint=checkpoint_find(p->runs+i, p->table, t->table, table_size);
 
-	individual=transition=population;
+	if (checkpoint<0) {
+		if (t->used) checkpoint_used(p->runs+i, p->runs[i].count, t->used, table_size);
+		*fitness=p->fitness[i];
+		return 0;
+	}
+	init_tape(orig_tape, work_tape);
+	checkpoint_restore(p->runs+i, checkpoint, work_tape, status, t->used, table_size);
+	return 1;
+}
+
+// clears t->used before the evaluation, or marks all the items as used, when it can't be known
+inline void reset_used(tTransitions * t, int all) {
+	if (t->used) memset(t->used, all ? 0xFF : 0, USED_WORDS(t->states*t->symbols)*sizeof(ulong));
+}
+
+/**
+ * @return the maximum of sorting_fitness() on the tape: correct symbols and order,
+ * no steps and the head never beyond the input
+ */
+double sorting_fitness_bound(tTape * orig_tape) {
+	tTapeMetrics * metrics=orig_tape->metrics;
+	int orig_unordered_cnt=orig_tape->input_len-metrics->correct_order-2-1,
+		max_delta_ordered_cnt=orig_tape->input_len-2-metrics->correct_order;
+	double fit_correct, fit_space;
+
+	if (orig_unordered_cnt<1) fit_correct=1;
+	else fit_correct=(1 + (double)max_delta_ordered_cnt/orig_unordered_cnt)/2;
+	fit_space=1-(double)(2-orig_tape->input_len)/(2+TAPE_LIMIT(orig_tape->input_len)-orig_tape->input_len);
+	return 0.5*fit_correct + 0.25 + 0.25*fit_space;
+}
+
+/**
+ * @return the order of the sample tapes for the bounded evaluation: the tapes which
+ * lowered the bound most per step (on average so far) go first
+ */
+int * tape_order(int n) {
+	int i, j, k;
+
+	if (n > Tape_cnt) {
+		Tape_order=realloc(Tape_order, n*sizeof(int));
+		Tape_gain=realloc(Tape_gain, n*sizeof(double));
+		if (Tape_order==NULL || Tape_gain==NULL) {
+			fprintf(stderr, "Can't allocate memory for the tape order!\n");
+			exit(-1);
+		}
+		for (i=0; i<n; i++) {
+			Tape_order[i]=i;
+			Tape_gain[i]=0;
+		}
+		Tape_cnt=n;
+	}
+	for (i=1; i<n; i++) {
+		k=Tape_order[i];
+		for (j=i; j>0 && Tape_gain[Tape_order[j-1]] < Tape_gain[k]; j--)
+			Tape_order[j]=Tape_order[j-1];
+		Tape_order[j]=k;
+	}
+	return Tape_order;
+}
+
+// the tape nr. i lowered the bound by loss in steps
+inline void tape_gain(int i, double loss, int steps) {
+	Tape_gain[i]=0.99*Tape_gain[i] + 0.01*loss/(steps+1);
+}
+
+void set_screening(tParams * params, tTape * orig_tapes, int n) {
+	int i;
+
+	Screen_pass=params->early_abort && params->screen_pass>0 && params->screen_pass<100 ? params->screen_pass : 0;
+	Screen_steps=params->screen_steps;
+	for (i=1, Screen_tape=0; i<n; i++)
+		if (orig_tapes[i].input_len < orig_tapes[Screen_tape].input_len) Screen_tape=i;
+}
+
+static int compare_scores(const void * a, const void * b) {
+	double x=*(double *)a, y=*(double *)b;
+	return x<y ? 1 : x>y ? -1 : 0;
+}
+
+/**
+ * @return the cutoff of the screening scores for the next kids: the Screen_pass % rank
+ * in the window, NO_THRESHOLD while the window isn't full
+ */
+static double screen_cutoff(void) {
+	return Screen_cnt < SCREEN_WINDOW ? NO_THRESHOLD : Screen_threshold;
+}
+
+/**
+ * The kid's screening score joins the window, in the order of the kids. Called by the thread
+ * which evolves the population, so the cutoff doesn't depend on the tasks' schedule.
+ * @param score NO_THRESHOLD if the kid wasn't screened
+ */
+static void screen_rank(double score) {
+	double ranked[SCREEN_WINDOW];
+
+	if (score==NO_THRESHOLD) return;
+	Screen_scores[Screen_cnt%SCREEN_WINDOW]=score;
+	if (++Screen_cnt==2*SCREEN_WINDOW) Screen_cnt=SCREEN_WINDOW;
+	if (Screen_cnt%SCREEN_RANKING==0 && Screen_cnt>=SCREEN_WINDOW) {
+		memcpy(ranked, Screen_scores, sizeof(ranked));
+		qsort(ranked, SCREEN_WINDOW, sizeof(double), compare_scores);
+		Screen_threshold=ranked[(SCREEN_WINDOW*Screen_pass-1)/100];
+	}
+}
+
+/**
+ * The first stage of the kids' evaluation: the screening tape, up to Screen_steps.
+ * @param cutoff of screen_cutoff(), taken before the kids' evaluation
+ * @param score gets the score for screen_rank(), NO_THRESHOLD without the screening
+ * @return 1 if the kid goes on to the full evaluation
+ */
+static int screen(tTransitions * t, tTape * orig_tapes, double cutoff, double * score) {
+	tTape * orig_tape=orig_tapes+Screen_tape, * work_tape;
+	tStatus status;
+	tTapeMetrics new_metrics;
+	int max_steps;
+
+	*score=NO_THRESHOLD;
+	if (!Screen_pass) return 1;
+	stats_add(stats, STAT_SCREENED, 1);
+	memset(&status, 0, sizeof(tStatus));
+	status.head=HEAD_START;
+	max_steps=get_max_steps(orig_tape->input_len);
+	if (Screen_steps < max_steps) max_steps=Screen_steps;
+	if (RLE_TAPE(Screen_tape)) {
+		rle_copy(Rle_tapes+Screen_tape, &Rle_work);
+		turing_rle(&Rle_work, t, max_steps, &status);
+		calc_rle_tape_metrics(&Rle_work, &new_metrics);
+	} else {
+		work_tape=work_tapes(1);
+		init_tape(orig_tape, work_tape);
+		turing_engine(work_tape, t, max_steps, &status);
+		calc_tape_metrics(work_tape, &new_metrics);
+	}
+	*score=sorting_fitness_metrics(&new_metrics, orig_tape->input_len, max_steps, &status, orig_tape->metrics,
+			t->symbols);
+	if (*score < cutoff) {
+		reset_used(t, 1);
+		return 0;
+	}
+	stats_add(stats, STAT_SCREEN_PASSES, 1);
+	return 1;
+}
+
+/**
+ * eval_sorting_fitness_n_tapes() without the tape log, for kids: resumed from the parent's
+ * checkpoints, if parent is not NULL, and given up as soon as the sum can't reach threshold.
+ * The sum is done in the order of the tapes, so the result is the same as without the bound.
+ * @return the fitness or FITNESS_REJECTED
+ */
+double eval_sorting_fitness_bounded(tTransitions * t, tParentRun * parent, tTape * orig_tapes, int n,
+		double threshold) {
+	tTape * work_tape=work_tapes(1);
+	tStatus status;
+	double fitness[n], bound[n], rest=0, sum=0;
+	int * order=tape_order(n), i, k;
+
+	for (i=0; i<n; i++) rest+=bound[i]=sorting_fitness_bound(orig_tapes+i);
+	for (k=0; k<n; k++) {
+		i=order[k];
+		memset(&status, 0, sizeof(tStatus));
+		status.head=HEAD_START;
+		if (RLE_TAPE(i)) {		// from the start, the parent's run isn't recorded there
+			fitness[i]=eval_rle(t, i, orig_tapes[i].metrics, &status);
+			tape_gain(i, bound[i]-fitness[i], status.steps);
+		} else if (parent==NULL ? (init_tape(orig_tapes+i, work_tape), 1) :
+				resume_parent_run(parent, i, t, orig_tapes+i, work_tape, &status, fitness+i)) {
+			turing_engine(work_tape, t, get_max_steps(orig_tapes[i].input_len), &status);
+			fitness[i]=sorting_fitness(work_tape, &status, orig_tapes[i].metrics, t->symbols);
+			tape_gain(i, bound[i]-fitness[i], status.steps);
+		}
+		if (fitness[i]<0) return -1;
+		sum+=fitness[i];
+		rest-=bound[i];
+		if (sum+rest < threshold-BOUND_EPSILON) {
+			reset_used(t, 1);
+			return FITNESS_REJECTED;
+		}
+	}
+	for (i=0, sum=0; i<n; i++) sum+=fitness[i];
+	return sum;
+}
+
+void eval_sorting_fitness_batch(tTransitions * t, int n, tTape * orig_tapes, int nr_of_tapes,
+		tParentRun ** parents, double threshold, double * fitness) {
+	tTape * tapes=work_tapes(n), * orig_tape;
+	tStatus * status=malloc(n*sizeof(tStatus));
+	tTransitions * batch=malloc(n*sizeof(tTransitions));
+	int * machine=malloc(n*sizeof(int)), * order=tape_order(nr_of_tapes), i, j, k, m, running;
+	double * tape_fitness=malloc(n*nr_of_tapes*sizeof(double)), bound[nr_of_tapes], rest=0;
+
+	if (status==NULL || batch==NULL || machine==NULL || tape_fitness==NULL) {
+		fprintf(stderr, "Can't allocate memory for the batch evaluation!\n");
+		exit(-1);
+	}
+	for (i=0; i<nr_of_tapes; i++) rest+=bound[i]=sorting_fitness_bound(orig_tapes+i);
+	for (j=0; j<n; j++) fitness[j]=0;		// the partial sums in the tape order
+	for (k=0; k<nr_of_tapes; k++) {
+		i=order[k];
+		orig_tape=orig_tapes+i;
+		rest-=bound[i];
+		if (RLE_TAPE(i)) {		// one by one, from the start
+			for (j=0; j<n; j++) {
+				if (fitness[j]<0) continue;
+				tape_fitness[j*nr_of_tapes+i]=eval_rle(t+j, i, orig_tape->metrics, status);
+				tape_gain(i, bound[i]-tape_fitness[j*nr_of_tapes+i], status->steps);
+			}
+			running=0;
+		} else for (j=0, running=0; j<n; j++) {
+			if (fitness[j]<0) continue;
+			memset(status+running, 0, sizeof(tStatus));
+			status[running].head=HEAD_START;
+			if (parents==NULL)
+				init_tape(orig_tape, tapes+running);
+			else if (!resume_parent_run(parents[j], i, t+j, orig_tape, tapes+running, status+running,
+					tape_fitness+j*nr_of_tapes+i))
+				continue;
+			batch[running]=t[j];
+			machine[running++]=j;
+		}
+		if (running) turing_batch(tapes, batch, running, get_max_steps(orig_tape->input_len), status);
+		for (m=0; m<running; m++) {
+			j=machine[m];
+			tape_fitness[j*nr_of_tapes+i]=sorting_fitness(tapes+m, status+m, orig_tape->metrics, t[j].symbols);
+			tape_gain(i, bound[i]-tape_fitness[j*nr_of_tapes+i], status[m].steps);
+		}
+		for (j=0; j<n; j++) {
+			if (fitness[j]<0) continue;
+			if (tape_fitness[j*nr_of_tapes+i]<0) fitness[j]=-1;
+			else if ((fitness[j]+=tape_fitness[j*nr_of_tapes+i])+rest < threshold-BOUND_EPSILON) {
+				fitness[j]=FITNESS_REJECTED;
+				reset_used(t+j, 1);
+			}
+		}
+	}
+	for (j=0; j<n; j++)
+		if (fitness[j]>=0)
+			for (i=0, fitness[j]=0; i<nr_of_tapes; i++) fitness[j]+=tape_fitness[j*nr_of_tapes+i];
+	free(status);
+	free(batch);
+	free(machine);
+	free(tape_fitness);
+}
+
+// counts the kid's evaluation on all the tapes, the second stage after screen()
+static inline void race_stats(double fitness) {
+	stats_add(stats, STAT_RACED, 1);
+	if (fitness!=FITNESS_REJECTED) stats_add(stats, STAT_RACE_PASSES, 1);
+}
+
+/**
+ * eval_sorting_fitness_n_tapes() behind the fitness cache.
+ * @param parent NULL, or the recorded parent's run to resume from
+ * @param threshold the kid is FITNESS_REJECTED, if it can't reach it, NO_THRESHOLD for the exact fitness
+ * @param cutoff of the screening (with a threshold), see screen()
+ * @param score the screening score, or NO_THRESHOLD, NULL without a threshold
+ */
+double eval_cached(tTransitions * t, tParentRun * parent, double threshold, double cutoff, double * score,
+		tTape * orig_tapes, int n) {
+	ulong hash=0;
+	double fitness;
+
+	if (score) *score=NO_THRESHOLD;
+	stats_add(stats, STAT_EVALUATIONS, 1);
+	reset_used(t, 0);
+	if (fitness_cache) {
+		hash=Genome_hash(t->table, t->states*t->symbols);
+		if (fitness_cache_get(fitness_cache, hash, &fitness)) {
+			reset_used(t, 1);
+			return fitness;
+		}
+	}
+	if (threshold!=NO_THRESHOLD && !screen(t, orig_tapes, cutoff, score)) return FITNESS_REJECTED;
+	fitness=eval_sorting_fitness_bounded(t, parent, orig_tapes, n, threshold);
+	if (threshold!=NO_THRESHOLD) race_stats(fitness);
+	// the items read by a failed machine depend on the order of the tapes, not known to the kids
+	if (fitness==-1) reset_used(t, 1);
+	// a rejection depends on the threshold, it's not the fitness
+	if (fitness_cache && fitness!=FITNESS_REJECTED) fitness_cache_put(fitness_cache, hash, fitness);
+	return fitness;
+}
+
+/**
+ * eval_sorting_fitness_batch() behind the fitness cache: only the misses go to the batch engine.
+ * The screening as in eval_cached(), scores[i] gets the score of t[i].
+ */
+void eval_batch_cached(tTransitions * t, int n, tTape * orig_tapes, int nr_of_tapes,
+		tParentRun ** parents, double threshold, double cutoff, double * scores, double * fitness) {
+	ulong * hash;
+	int * miss, misses=0, i;
+	tTransitions * batch;
+	tParentRun ** batch_parents;
+	double * batch_fitness;
+
+	stats_add(stats, STAT_EVALUATIONS, n);
+	for (i=0; i<n; i++) {
+		reset_used(t+i, 0);
+		if (scores) scores[i]=NO_THRESHOLD;
+	}
+	if (fitness_cache==NULL && (!Screen_pass || threshold==NO_THRESHOLD)) {
+		eval_sorting_fitness_batch(t, n, orig_tapes, nr_of_tapes, parents, threshold, fitness);
+		for (i=0; i<n; i++) {
+			if (fitness[i]==-1) reset_used(t+i, 1);
+			if (threshold!=NO_THRESHOLD) race_stats(fitness[i]);
+		}
+		return;
+	}
+	hash=malloc(n*sizeof(ulong));
+	miss=malloc(n*sizeof(int));
+	batch=malloc(n*sizeof(tTransitions));
+	batch_parents=malloc(n*sizeof(tParentRun *));
+	batch_fitness=malloc(n*sizeof(double));
+	if (hash==NULL || miss==NULL || batch==NULL || batch_parents==NULL || batch_fitness==NULL) {
+		fprintf(stderr, "Can't allocate memory for the batch evaluation!\n");
+		exit(-1);
+	}
+	for (i=0; i<n; i++) {
+		if (fitness_cache) {
+			hash[i]=Genome_hash(t[i].table, t[i].states*t[i].symbols);
+			if (fitness_cache_get(fitness_cache, hash[i], fitness+i)) {
+				reset_used(t+i, 1);
+				continue;
+			}
+		}
+		if (threshold!=NO_THRESHOLD && !screen(t+i, orig_tapes, cutoff, scores+i)) {
+			fitness[i]=FITNESS_REJECTED;
+			continue;
+		}
+		batch[misses]=t[i];
+		if (parents) batch_parents[misses]=parents[i];
+		miss[misses++]=i;
+	}
+	eval_sorting_fitness_batch(batch, misses, orig_tapes, nr_of_tapes, parents ? batch_parents : NULL,
+			threshold, batch_fitness);
+	for (i=0; i<misses; i++) {
+		fitness[miss[i]]=batch_fitness[i];
+		if (batch_fitness[i]==-1) reset_used(t+miss[i], 1);
+		if (threshold!=NO_THRESHOLD) race_stats(batch_fitness[i]);
+		if (fitness_cache && batch_fitness[i]!=FITNESS_REJECTED)
+			fitness_cache_put(fitness_cache, hash[miss[i]], batch_fitness[i]);
+	}
+	free(hash);
+	free(miss);
+	free(batch);
+	free(batch_parents);
+	free(batch_fitness);
+}
+
+/**
+ * Evaluates the machines like eval_batch_cached(), in the work stealing mode by all the threads:
+ * the machines are cut into tasks (of a batch for the batch engine, one machine otherwise)
+ * and each thread takes the next task when it's done, so the machines running to the step limit
+ * don't leave the other threads idle.
+ */
+void eval_kids(tTransitions * t, int n, tTape * orig_tapes, int nr_of_tapes,
+		tParentRun ** parents, double threshold, double cutoff, double * scores, double * fitness, tParams * params) {
+	int i, grain=params->engine==ENGINE_BATCH ? BATCH_KIDS : 1;
+
+	if (!params->work_stealing) {
+		eval_batch_cached(t, n, orig_tapes, nr_of_tapes, parents, threshold, cutoff, scores, fitness);
+		return;
+	}
+	#pragma omp parallel
+	#pragma omp single
+	for (i=0; i<n; i+=grain) {
+		#pragma omp task firstprivate(i)
+		if (params->engine==ENGINE_BATCH)
+			eval_batch_cached(t+i, i+grain<n ? grain : n-i, orig_tapes, nr_of_tapes,
+					parents ? parents+i : NULL, threshold, cutoff, scores ? scores+i : NULL, fitness+i);
+		else
+			fitness[i]=eval_cached(t+i, parents ? parents[i] : NULL, threshold, cutoff, scores ? scores+i : NULL,
+					orig_tapes, nr_of_tapes);
+	}
+}
+
+void generate_population(tPopulation * population, tParams * params) {
+	int i, st, sy;
+	tTransTableItem * transition;
+
+	transition=population->tables;
 	for (i=0; i<params->population_size; i++) { // for all the individuals
 		if (log_level>=LOG_DEBUG_3)
 			printf("Generating individual %d\n", i);
 		for (st=0; st<params->states; st++)			// for all their states
 			for (sy=0; sy<params->symbols; sy++)	// for all their symbols
-				*transition++=Pregen_tuples[rand()%Pregen_tuples_cnt];
-		trans.table=population_fitness[i].table=individual;	
-		individual=transition;
+				*transition++=Pregen_tuples[prng_below(Pregen_tuples_cnt)];
 	}
 }
 
@@ -184,99 +743,331 @@ inline int nr_of_kids(int generation, int i, int population_size) {
 	else return population_size/3;
 }
 
-inline void mutate(tIndividual * parent, tIndividual * kid, int states, int symbols) {
-	int table_size=states*symbols, trans_nr, mutations=rand()%table_size, i;
+// the body of mutate(), table_size is a constant in the kernels of KERNEL_SHAPES
+static inline __attribute__((always_inline)) int mutate_table(tTransTableItem * parent, ulong * parent_used,
+		tTransTableItem * kid, int table_size) {
+	int trans_nr, mutations=prng_below(table_size), i, changed=kid==parent;
+	tTransTableItem old;
 	//first of all: copy the parent table into the kid's table
-	for (i=0; i<table_size; i++) kid->table[i]=parent->table[i];
+	if (kid!=parent) memcpy(kid, parent, table_size*sizeof(tTransTableItem));
 	//then, make the mutation(s)
 	for (i=0; i<mutations; i++) {
-		trans_nr=rand()%table_size;
-		kid->table[trans_nr]=Pregen_tuples[rand()%Pregen_tuples_cnt];
-	}
-}
-void dump(tIndividual * individual, ulong generation, tParams * params, int thread_id, char * tape_log, ulong restarts) {
-	tTransTableItem * t = individual->table;
-	int st, sy;
-	unsigned long ulong_fit;
-	char fname [255];
-	FILE * f, *ft;
-
-	if (individual->fitness < ULONG_MAX/1e9)
-		ulong_fit=1e8*individual->fitness;
-	else
-		ulong_fit=ULONG_MAX;
-
-
-	sprintf(fname, "%s/%.9lu-%d-%lu-%lu.gv",
-			params->output, ulong_fit, thread_id, generation, restarts);
-	if ( (f=fopen(fname, "w"))==NULL ||
-		 (ft=fopen(strcat(fname,".txt"), "w"))==NULL) {
-		fprintf(stderr, "Error: Can't open file for new graph, exiting.\n");
-		exit(EXIT_FAILURE);
-	}
-	fprintf(f,
-		"digraph \"Finite state machine, fitness=%.6lf, "
-				  "population_size=%d, states=%d, symbols=%d, "
-				  "best_cnt=%d, kids_cnt=%d\" {\n"
-		"	rankdir=LR;\n"
-		"	size=\"8,5\"\n"
-		"S12 [shape=doublecircle];\n"
-		"	node [shape = circle];\n",
-		individual->fitness,
-		params->population_size, params->states, params->symbols,
-		params->best_cnt, params->kids_cnt
-	);
-	if (log_level>=LOG_BEST_1)
-		printf("Fitness=%.6lf, thread_id=%d, generation=%lu, restarts=%lu\n",
-				individual->fitness, thread_id, generation, restarts);
-	for (st=0; st<params->states; st++)			// for all their states
-		for (sy=0; sy<params->symbols; sy++, t++)	{// for all their symbols
-			fprintf(ft, "{ %d, %d, %d },\n", t->state, t->symbol, t->shift);
-			fprintf(f, "	S%d -> S%d [ label = \"%d / %d, %s\" ];\n",
-						st, t->state, sy, t->symbol, shift2str(t->shift));
+		trans_nr=prng_below(table_size);
+		old=kid[trans_nr];
+		kid[trans_nr]=Pregen_tuples[prng_below(Pregen_tuples_cnt)];
+		if (USED_GET(parent_used, trans_nr) && old!=kid[trans_nr])
+			changed=1;
+	}
+	return changed;
+}
+
+static int mutate_generic(tTransTableItem * parent, ulong * parent_used, tTransTableItem * kid, int states, int symbols) {
+	return mutate_table(parent, parent_used, kid, states*symbols);
+}
+
+#define MUTATE_KERNEL(STATES, SYMBOLS) \
+static int mutate_##STATES##x##SYMBOLS(tTransTableItem * parent, ulong * parent_used, tTransTableItem * kid, \
+		int states, int symbols) { \
+	if (states!=STATES || symbols!=SYMBOLS) return mutate_generic(parent, parent_used, kid, states, symbols); \
+	return mutate_table(parent, parent_used, kid, STATES*SYMBOLS); \
+}
+KERNEL_SHAPES(MUTATE_KERNEL)
+#undef MUTATE_KERNEL
+
+// the kernel of the run's shape, see set_kernels()
+int (*Mutation)(tTransTableItem * parent, ulong * parent_used, tTransTableItem * kid, int states, int symbols)=mutate_generic;
+
+void set_kernels(int states, int symbols) {
+	Mutation=mutate_generic;
+#define SELECT_KERNEL(STATES, SYMBOLS) \
+	if (states==STATES && symbols==SYMBOLS) Mutation=mutate_##STATES##x##SYMBOLS;
+	KERNEL_SHAPES(SELECT_KERNEL)
+#undef SELECT_KERNEL
+	Genome_hash=genome_hash_kernel(states*symbols);
+}
+
+/**
+ * @return 0 if the kid behaves exactly as the parent, because the mutations changed
+ * 		   only the transitions never used by the parent; 1 otherwise (kid is evaluated)
+ */
+inline int mutate(tTransTableItem * parent, ulong * parent_used, tTransTableItem * kid, int states, int symbols) {
+	return Mutation(parent, parent_used, kid, states, symbols);
+}
+
+// @return 1 if the new best of the thread is worth a record: with islands, only a new best of all of them
+inline int new_best(double fitness) {
+	return islands==NULL || island_best_update(islands, fitness);
+}
+
+void eval_population(tPopulation * population, tParams * params,
+		tTape * sample_tapes, int nr_of_tapes, dpqueue_t * pqueue) {
+	int i, population_size=params->population_size;
+	tTransitions trans={params->states, params->symbols};
+
+	if (params->engine==ENGINE_BATCH || params->work_stealing) {
+		tTransitions * batch=malloc(population_size*sizeof(tTransitions));
+		if (batch==NULL) {
+			fprintf(stderr, "Can't allocate memory for such a population size!\n");
+			exit(-1);
 		}
-	fprintf(f, "}\n");
-	fprintf(ft, "Tape content:\n%s", tape_log);
-	fclose(f);
-	fclose(ft);
+		for (i=0; i<population_size; i++) {
+			batch[i]=trans;
+			batch[i].table=POPULATION_TABLE(population, i);
+			batch[i].used=POPULATION_USED(population, i);
+		}
+		eval_kids(batch, population_size, sample_tapes, nr_of_tapes, NULL, NO_THRESHOLD, NO_THRESHOLD, NULL,
+				population->fitness, params);
+		for (i=0; i<population_size; i++)
+			dpqueue_insert(pqueue, i, population->fitness[i]);
+		free(batch);
+		return;
+	}
+	for (i=0; i<population_size; i++) {
+		trans.table=POPULATION_TABLE(population, i);
+		trans.used=POPULATION_USED(population, i);
+		population->fitness[i]=eval_cached(&trans, NULL, NO_THRESHOLD, NO_THRESHOLD, NULL, sample_tapes, nr_of_tapes);
+		dpqueue_insert(pqueue, i, population->fitness[i]);
+	}
+}
+
+// the arena sizes of the population parts and their sum
+static size_t population_memory(tParams * params, size_t * tables, size_t * fitness, size_t * used) {
+	size_t n=params->population_size, table_size=params->states*params->symbols;
+
+	*tables=arena_size(n*table_size*sizeof(tTransTableItem));
+	*fitness=arena_size(n*sizeof(double));
+	*used=arena_size(n*USED_WORDS(table_size)*sizeof(ulong));
+	return *tables+*fitness+*used;
 }
+
+void print_memory_footprint(tParams * params, int nr_of_tapes, int threads) {
+	size_t tables, fitness, used, queue, checkpoints=0, snapshot=0, parents,
+		arena=population_memory(params, &tables, &fitness, &used);
+
+	queue=sizeof(dpqueue_t)+(params->population_size+1)*sizeof(tDpqNode);
+	if (params->checkpoint_interval>0) {
+		if (params->work_stealing) parents=params->best_cnt;
+		else parents=params->engine==ENGINE_BATCH ? (BATCH_KIDS+params->kids_cnt-1)/params->kids_cnt : 1;
+		checkpoints=parents*(sizeof(tParentRun)+params->states*params->symbols*(sizeof(tTransTableItem)+nr_of_tapes)+
+				nr_of_tapes*(sizeof(tRunCheckpoints)+sizeof(double)+CHECKPOINTS_MAX*(sizeof(tCheckpoint)+TAPE_LEN)));
+	}
+	if (params->snapshot_interval>0) snapshot=snapshot_size(params);
+	printf("Memory per thread: genomes=%.1lf MB, fitness=%.1lf MB, used bitmaps=%.1lf MB "
+			"(arena of %.1lf MB), queue=%.1lf MB, checkpoints=%.1lf MB, snapshot=%.1lf MB\n",
+			tables/1e6, fitness/1e6, used/1e6, arena/1e6, queue/1e6, checkpoints/1e6, snapshot/1e6);
+	printf("Memory of %d threads: %.1lf MB\n", threads, threads*(double)(arena+queue+checkpoints+snapshot)/1e6);
+}
+
+// allocates the population of the current thread from the arena
+void population_init(tPopulation * population, tArena * arena, tParams * params) {
+	size_t tables, fitness, used, size=population_memory(params, &tables, &fitness, &used);
+
+	if (arena_init(arena, size, params->pages)) {
+		fprintf(stderr, "Can't allocate memory for such a population size!\n");
+		exit(-1);
+	}
+	population->size=params->population_size;
+	population->table_size=params->states*params->symbols;
+	population->used_words=USED_WORDS(population->table_size);
+	population->tables=arena_alloc(arena, tables);
+	population->fitness=arena_alloc(arena, fitness);
+	population->used=arena_alloc(arena, used);
+}
+
+/**
+ * @return the early abort's threshold of the kid, which replaces the worst individual: its fitness.
+ * A rejected kid there is below the individual it replaced, so the threshold it was rejected
+ * against (in last) stays, else no kid after it could be aborted.
+ */
+static inline double kid_threshold(tParams * params, double worst, double * last) {
+	if (!params->early_abort) return NO_THRESHOLD;
+	if (worst!=FITNESS_REJECTED || *last==NO_THRESHOLD) *last=worst;
+	return *last;
+}
+
+/**
+ * The batch engine and work stealing variant of the kids loop in evolve_turing(): the kids of the parents
+ * ranked first..last-1 are mutated into a scratch block and evaluated together, then each
+ * of them replaces the worst individual. The kids which differ from their parents only in
+ * unused transitions inherit the parent's fitness instead.
+ */
+void evolve_kids_batch(ulong first, ulong last, tParams * params, tPopulation * population,
+		tTape * sample_tapes, int nr_of_tapes, dpqueue_t * pqueue, ulong generation, int thread_id, ulong restarts,
+		ulong * last_success_generation, double * threshold) {
+	int kid, changed=0, parent, new_kid_place, kids_cnt=params->kids_cnt, n=(last-first)*kids_cnt,
+		table_size=params->states*params->symbols, population_size=params->population_size,
+		used_words=USED_WORDS(table_size);
+	tTransTableItem * tables=malloc(n*table_size*sizeof(tTransTableItem));
+	ulong * used=malloc(n*used_words*sizeof(ulong));
+	tTransitions * trans=malloc(n*sizeof(tTransitions)), * batch=malloc(n*sizeof(tTransitions));
+	tParentRun * parent_runs=NULL, ** batch_parents=malloc(n*sizeof(tParentRun *));
+	double * fitness=malloc(n*sizeof(double)), * batch_fitness=malloc(n*sizeof(double)),
+		* scores=malloc(n*sizeof(double));
+	int * batch_kid=malloc(n*sizeof(int)), * record=malloc((last-first)*sizeof(int)), records=0, j;
+	ulong i;
+
+	if (tables==NULL || used==NULL || trans==NULL || batch==NULL || batch_parents==NULL ||
+			fitness==NULL || batch_fitness==NULL || scores==NULL || batch_kid==NULL || record==NULL) {
+		fprintf(stderr, "Can't allocate memory for the batch of kids!\n");
+		exit(-1);
+	}
+	if (params->checkpoint_interval>0)
+		parent_runs=get_parent_runs(last-first, params, nr_of_tapes);
+	stats_phase(stats, PHASE_MUTATION);
+	for (i=first, kid=0; i<last; i++) {
+		parent=dpqueue_get(pqueue, i);
+		for (; kid<(i-first+1)*kids_cnt; kid++) {
+			trans[kid].states=params->states;
+			trans[kid].symbols=params->symbols;
+			trans[kid].table=tables+kid*table_size;
+			trans[kid].used=used+kid*used_words;
+			if (mutate(POPULATION_TABLE(population, parent), POPULATION_USED(population, parent),
+					trans[kid].table, params->states, params->symbols)) {
+				if (parent_runs) {
+					if (records==0 || record[records-1]!=i)
+						record[records++]=i;
+					batch_parents[changed]=parent_runs+i-first;
+				}
+				batch[changed]=trans[kid];
+				batch_kid[changed++]=kid;
+			} else {	// the kid got the parent's behaviour, and so its fitness, too
+				memcpy(trans[kid].used, POPULATION_USED(population, parent), used_words*sizeof(ulong));
+				fitness[kid]=population->fitness[parent];
+			}
+		}
+	}
+	stats_phase(stats, PHASE_EVALUATION);
+	// the population doesn't change until the kids are evaluated, the parents' runs are recorded now
+	#pragma omp parallel for schedule(dynamic) if(params->work_stealing)
+	for (j=0; j<records; j++)
+		record_parent_run(parent_runs+record[j]-first, POPULATION_TABLE(population, dpqueue_get(pqueue, record[j])),
+				params, sample_tapes, nr_of_tapes);
+	// the kids replace the worst ones, who are the threshold for all of them, and share the screening cutoff
+	eval_kids(batch, changed, sample_tapes, nr_of_tapes, parent_runs ? batch_parents : NULL,
+			kid_threshold(params, population->fitness[dpqueue_get(pqueue, population_size)], threshold),
+			screen_cutoff(), scores, batch_fitness, params);
+	for (kid=0; kid<changed; kid++) {
+		fitness[batch_kid[kid]]=batch_fitness[kid];
+		screen_rank(scores[kid]);
+	}
+	stats_phase(stats, PHASE_SELECTION);
+	for (kid=0; kid<n; kid++) {
+		new_kid_place=dpqueue_get(pqueue, population_size);
+		memcpy(POPULATION_TABLE(population, new_kid_place), trans[kid].table, table_size*sizeof(tTransTableItem));
+		memcpy(POPULATION_USED(population, new_kid_place), trans[kid].used, used_words*sizeof(ulong));
+		population->fitness[new_kid_place]=fitness[kid];
+		if (dpqueue_priority_changed(pqueue, population_size, fitness[kid])==1) {
+			stats_add(stats, STAT_IMPROVEMENTS, 1);
+			if (new_best(fitness[kid]))
+				results_best(results, thread_id, trans[kid].table, fitness[kid], generation, restarts);
+			*last_success_generation=generation;
+		}
+	}
+	free(tables);
+	free(used);
+	free(trans);
+	free(batch);
+	free(batch_parents);
+	free(fitness);
+	free(batch_fitness);
+	free(scores);
+	free(batch_kid);
+	free(record);
+}
+
+// the immigrant replaces the worst individual, if it's better
+void immigrate(tPopulation * population, dpqueue_t * pqueue, tTransTableItem * table, ulong * used, double fitness) {
+	int individual=dpqueue_get(pqueue, population->size);
+
+	if (fitness <= population->fitness[individual]) return;
+	memcpy(POPULATION_TABLE(population, individual), table, population->table_size*sizeof(tTransTableItem));
+	memcpy(POPULATION_USED(population, individual), used, population->used_words*sizeof(ulong));
+	population->fitness[individual]=fitness;
+	dpqueue_priority_changed(pqueue, population->size, fitness);
+}
+
+/**
+ * Sends the best individuals of the thread to the neighbour island(s) and to the coordinator,
+ * then takes in the immigrants from both.
+ */
+void migrate(tPopulation * population, tParams * params, dpqueue_t * pqueue, int thread_id) {
+	tTransTableItem table[population->table_size];
+	ulong used[population->used_words];
+	double fitness;
+	int i, individual;
+
+	for (i=1; i<=params->migrants && i<=population->size; i++) {
+		individual=dpqueue_get(pqueue, i);
+		if (islands)
+			island_send(islands, thread_id, POPULATION_TABLE(population, individual),
+					POPULATION_USED(population, individual), population->fitness[individual]);
+		if (cluster)
+			cluster_send(cluster, POPULATION_TABLE(population, individual),
+					POPULATION_USED(population, individual), population->fitness[individual]);
+	}
+	while (islands && island_receive(islands, thread_id, table, used, &fitness))
+		immigrate(population, pqueue, table, used, fitness);
+	// the coordinator's migrants are for all the threads
+	for (i=0; cluster && i<params->migrants && cluster_receive(cluster, table, used, &fitness); i++)
+		immigrate(population, pqueue, table, used, fitness);
+}
+
 int evolve_turing(tParams * params, tTape * sample_tapes, int nr_of_tapes) {
 	int thread_id, population_size=params->population_size,
 		symbols=params->symbols,
-		states=params->states;
-	tTransTableItem population[population_size*symbols*states];
-	tIndividual population_fitness [population_size],
-				* parent, * new_kid_place;
-	char tape_log[TAPE_LOG_SIZE]; // this is a bit unsafe - I should better calculate how big the log should be...
+		states=params->states, parent, new_kid_place;
+	tArena arena;
+	tPopulation population;
 	tTransitions trans={states, symbols};
-	pqueue_t * pqueue = pqueue_init(population_size);
+	tParentRun * parent_run=NULL;
+	tSnapshot snapshot={NULL};
+	dpqueue_t * pqueue = dpqueue_init(population_size);
 	ulong generation=0, i, kid, new_pos,
 			last_success_generation=0, restarts=0;
+	time_t last_snapshot=time(NULL);
 	//ulong best_cnt, kids_cnt ;
-	double old_fitness;
+	double threshold=NO_THRESHOLD, score;
 
 	thread_id=omp_get_thread_num();
+	stats_thread(thread_id);
 
-	
-	if (population==NULL || population_fitness==NULL || pqueue==NULL) {
+	if (pqueue==NULL) {
 		fprintf(stderr, "Can't allocate memory for such a population size!\n");
 		exit(-1);
 	}
+	if (!params->resume)	// else the population is mapped from its snapshot
+		population_init(&population, &arena, params);
+	prng_seed(params->seed, thread_id);
 
 	init_evolution(states, symbols);
-
-	generate_population(population, population_fitness, params);
-	for (i=0; i<population_size; i++) {
-		trans.table=population_fitness[i].table;
-		population_fitness[i].fitness=eval_sorting_fitness_n_tapes(&trans, sample_tapes, nr_of_tapes, tape_log);
-		pqueue_insert(pqueue, &population_fitness[i]);
+	if (params->resume) {
+		snapshot_load(params, thread_id, &population, pqueue, &generation, &last_success_generation, &restarts);
+		printf("Thread %d: resumed at generation %lu, best fitness=%.6lf\n", thread_id, generation,
+				population.fitness[dpqueue_get(pqueue, 1)]);
+	} else {
+		generate_population(&population, params);
+		eval_population(&population, params, sample_tapes, nr_of_tapes, pqueue);
 	}
-	while (1) {
+	while (params->generations==0 || generation<params->generations) {
 		// for each of the best individuals in population:
 		//best_cnt=nr_of_best(generation, population_size);
 		for (i=1; i<params->best_cnt; i++)  {
-			parent=pqueue_get(pqueue, i);	 // get the i-th top ranking individuals:
-			old_fitness=parent->fitness;
+			if (params->work_stealing) {	// the kids of the whole generation at once
+				evolve_kids_batch(i, params->best_cnt, params, &population, sample_tapes, nr_of_tapes, pqueue,
+						generation, thread_id, restarts, &last_success_generation, &threshold);
+				break;
+			}
+			if (params->engine==ENGINE_BATCH) {	// kids of BATCH_KIDS/kids_cnt parents at once
+				kid=i+(BATCH_KIDS+params->kids_cnt-1)/params->kids_cnt;
+				if (kid>params->best_cnt) kid=params->best_cnt;
+				evolve_kids_batch(i, kid, params, &population, sample_tapes, nr_of_tapes, pqueue,
+						generation, thread_id, restarts, &last_success_generation, &threshold);
+				i=kid-1;
+				continue;
+			}
+			parent=dpqueue_get(pqueue, i);	 // get the i-th top ranking individuals:
+			if (params->checkpoint_interval>0)
+				parent_run=get_parent_runs(1, params, nr_of_tapes);
 			//kids_cnt=nr_of_kids(generation, i, population_size);
 			for (kid=0; kid<params->kids_cnt; kid++) { // generate new kids:
 				/** create new  mutation of the i-th parent
@@ -284,33 +1075,68 @@ int evolve_turing(tParams * params, tTape * sample_tapes, int nr_of_tapes) {
 				 * Note: It can happen that the parent becomes the worst individual inside this loop,
 				 * and thus will be replaced by one of its kids/mutations, but that's...life.
 				 */
-				new_kid_place=pqueue_get(pqueue, population_size);
-
-				mutate(parent, new_kid_place, states, symbols);
-				trans.table=new_kid_place->table;
-				new_kid_place->fitness=eval_sorting_fitness_n_tapes(&trans, sample_tapes, nr_of_tapes, tape_log);
-				new_pos=pqueue_priority_changed(pqueue, old_fitness, population_size);
+				new_kid_place=dpqueue_get(pqueue, population_size);
+				trans.table=POPULATION_TABLE(&population, new_kid_place);
+				trans.used=POPULATION_USED(&population, new_kid_place);
+				stats_phase(stats, PHASE_MUTATION);
+				if (mutate(POPULATION_TABLE(&population, parent), POPULATION_USED(&population, parent),
+						trans.table, states, symbols)) {
+					stats_phase(stats, PHASE_EVALUATION);
+					if (parent_run && !parent_run->valid)
+						record_parent_run(parent_run, POPULATION_TABLE(&population, parent), params,
+								sample_tapes, nr_of_tapes);
+					population.fitness[new_kid_place]=eval_cached(&trans, parent_run,
+							kid_threshold(params, population.fitness[new_kid_place], &threshold),
+							screen_cutoff(), &score, sample_tapes, nr_of_tapes);
+					screen_rank(score);
+				} else {	// the kid got the behaviour, and so the fitness, of the table now in the parent's place
+					population.fitness[new_kid_place]=population.fitness[parent];
+					memcpy(trans.used, POPULATION_USED(&population, parent), population.used_words*sizeof(ulong));
+				}
+				stats_phase(stats, PHASE_SELECTION);
+				new_pos=dpqueue_priority_changed(pqueue, population_size, population.fitness[new_kid_place]);
 				if (new_pos==1) {
-					dump(new_kid_place, generation, params, thread_id, tape_log, restarts);
+					stats_add(stats, STAT_IMPROVEMENTS, 1);
+					if (new_best(population.fitness[new_kid_place]))
+						results_best(results, thread_id, trans.table, population.fitness[new_kid_place],
+								generation, restarts);
 					last_success_generation=generation;
 				}
 			}
 		}
 		if (log_level>=LOG_BEST_1)
 			printf("Generation %lu finished\n", generation);
+		results_generation(results, thread_id);
 		generation++;
+		stats_add(stats, STAT_GENERATIONS, 1);
+		if ((islands || cluster) && generation%params->migration_interval==0) {
+			stats_phase(stats, PHASE_MIGRATION);
+			migrate(&population, params, pqueue, thread_id);
+		}
 		if (generation-last_success_generation > params->degeneration_cnt) {
 			printf("Thread %d: point of degeneration reached. Generating the whole new population\n", thread_id);
+			stats_phase(stats, PHASE_RESTART);
+			stats_add(stats, STAT_RESTARTS, 1);
 			restarts++;
 			last_success_generation=generation;
-			pqueue_reset(pqueue);
-			generate_population(population, population_fitness, params);
-			for (i=0; i<population_size; i++) {
-				trans.table=population_fitness[i].table;
-				population_fitness[i].fitness=eval_sorting_fitness_n_tapes(&trans, sample_tapes, nr_of_tapes, tape_log);
-				pqueue_insert(pqueue, &population_fitness[i]);
-			}
+			dpqueue_reset(pqueue);
+			generate_population(&population, params);
+			eval_population(&population, params, sample_tapes, nr_of_tapes, pqueue);
 
 		}
+		if (params->snapshot_interval>0 && time(NULL)-last_snapshot >= params->snapshot_interval) {
+			last_snapshot=time(NULL);
+			stats_phase(stats, PHASE_SNAPSHOT);
+			snapshot_take(&snapshot, params, thread_id, omp_get_num_threads(), &population, pqueue,
+					generation, last_success_generation, restarts);
+		}
+	}
+	if (params->snapshot_interval>0) {		// the state at the last generation
+		stats_phase(stats, PHASE_SNAPSHOT);
+		snapshot_finish(&snapshot, params, thread_id, omp_get_num_threads(), &population, pqueue,
+				generation, last_success_generation, restarts);
 	}
+	dpqueue_free(pqueue);
+	if (!params->resume) arena_free(&arena);
+	return 0;
 }
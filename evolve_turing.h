@@ -1,16 +1,27 @@
 #ifndef EVOLVE_TURING_H
 #define EVOLVE_TURING_H
 
+#include <stdio.h>
+#include <float.h>
 #include "turing.h"
+#include "checkpoint.h"
+#include "arena.h"
+#include "island.h"
+#include "rle_tape.h"
 
 #define MAX_STEPS(TAPE) sizeof(TAPE)*sizeof(TAPE)*sizeof(TAPE)
-#define TAPE_LEN 1000
 #define SAMPLE_TAPE1 {BLANK,3,1,2,1,2,3,2,3,3,3,2,2,2,1,1,1,BLANK}
 #define SAMPLE_TAPE2 {BLANK,3,2,1,3,2,1,3,2,1,3,2,1,3,2,1,1,1,1,BLANK}
 #define SAMPLE_TAPE3 {BLANK,3,3,3,3,3,3,3,3,2,2,2,2,2,2,2,2,2,1,1,1,1,1,1,1,BLANK}
 #define NR_OF_SAMPLE_TAPES 3
 #define SAMPLE_TAPE_SYMBOLS 4
-#define TAPE_LOG_SIZE 65535
+#define BATCH_KIDS 256		// nr. of kids evaluated together by the batch engine
+#define FITNESS_REJECTED -2	// the evaluation stopped, the fitness would be under the threshold
+#define NO_THRESHOLD (-DBL_MAX)
+#define BOUND_EPSILON 1e-9	// rounding of the sums, no kid is rejected by it
+#define SCREEN_DEFAULT_STEPS 512	// of the kids' run on the screening tape
+#define SCREEN_WINDOW 256		// the last screening scores, which rank the next kids
+#define SCREEN_RANKING 32		// screenings between the rankings of the window
 
 typedef struct {
 	int population_size,
@@ -18,22 +29,151 @@ typedef struct {
 		symbols,
 		best_cnt, kids_cnt, degeneration_cnt;
 	char * output;
+	tEngine engine;
+	long cache_size;	// nr. of fitness values in the cache, 0=no cache
+	int checkpoint_interval;	// steps between the checkpoints of the parents' runs, 0=kids run from the start
+	int early_abort;	// 1=stop evaluating the kids, who can't beat the individual they replace
+	tPages pages;		// pages of the population arenas
+	ulong seed;			// of the random numbers, each thread has its own stream
+	tTopology topology;	// of the islands, TOPOLOGY_NONE=the threads evolve independently
+	int migration_interval, migrants;	// generations between the migrations, individuals sent by each
+	int work_stealing;	// 1=a single population, whose kids are evaluated by all the threads
+	char * coordinator;	// the address to serve the workers at, or NULL
+	char * worker;		// the coordinator's address, if this process is its worker, or NULL
+	int snapshot_interval;	// seconds between the snapshots of the evolution state, 0=none
+	int resume;			// 1=continue from the snapshots in output
+	ulong generations;	// evolve_turing() returns at this generation, 0=never
+	int stats_interval;	// seconds between the lines of the stats file, 0=only on SIGUSR1
+	int screen_pass;	// % of the kids, by the rank of their screening score, evaluated on all the tapes, 0=all
+	int screen_steps;	// the step limit of the screening run
 } tParams;
 
-
+// a standalone individual, as queued by pqueue.h
 typedef struct {
 	tTransTableItem * table;
 	double fitness;
+	ulong * used;		// bitmap of the table items read during the evaluation
 } tIndividual;
 
+/**
+ * The population of one thread as parallel arrays, the individual i has the table
+ * POPULATION_TABLE(p, i), the fitness p->fitness[i] and the bitmap POPULATION_USED(p, i).
+ * The genomes are contiguous, the ranking scans the fitness without touching them.
+ */
+typedef struct {
+	int size, table_size, used_words;
+	tTransTableItem * tables;	// [size*table_size]
+	double * fitness;			// [size]
+	ulong * used;				// [size*used_words]
+} tPopulation;
+
+#define POPULATION_TABLE(P, I) ((P)->tables+(size_t)(I)*(P)->table_size)
+#define POPULATION_USED(P, I) ((P)->used+(size_t)(I)*(P)->used_words)
+
 typedef struct {
-	int symbol_count[SAMPLE_TAPE_SYMBOLS];
+	int symbol_count[TRANS_MAX_SYMBOLS];	// by any symbol a machine can write
 	int correct_order;
 } tTapeMetrics; 
 
+// the step limit of the tapes of this length
+inline int get_max_steps(int input_len);
+// copies the input into the work tape and clears what the previous run left there
+inline void init_tape(tTape * orig_tape, tTape * work_tape);
 void calc_all_tapes_metrics(tTape * tapes, tTapeMetrics * metrics, int n);
+// calc_tape_metrics() of a run-length encoded tape, in O(number of runs)
+void calc_rle_tape_metrics(tRleTape * tape, tTapeMetrics * metrics);
+/**
+ * The sample tapes of at least min_len cells get evaluated on their run-length encoded
+ * copies (see rle_tape.h), the shorter ones stay flat; min_len 0 = all flat.
+ * The fitness is the same, only its cost follows the number of runs instead of cells.
+ */
+void set_rle_tapes(tTape * orig_tapes, int n, int min_len);
+double sorting_fitness(tTape * tape, tStatus * status, tTapeMetrics * orig_metrics, int symbols);
 double eval_sorting_fitness(tTransitions * t, tTape * tape, tTapeMetrics * orig_metrics);
-double eval_sorting_fitness_n_tapes(tTransitions * t, tTape * orig_tapes, int n, char * tape_log);
+double eval_sorting_fitness_n_tapes(tTransitions * t, tTape * orig_tapes, int n);
+
+/**
+ * A trace file: tTraceHeader, the table, then a section for each tape: tTraceTape,
+ * the input, the steps, the final tStatus, the fitness (double) and the final tape
+ * (input_len cells). Read by trace2txt.
+ */
+#define TRACE_MAGIC "ETTRACE"
+typedef struct {
+	char magic[8];
+	int states, symbols, tapes;
+} tTraceHeader;
+
+typedef struct {
+	int input_len, steps;
+} tTraceTape;
+
+// the configuration before a step
+typedef struct __attribute__((packed)) {
+	uchar state;
+	schar symbol;	// under the head
+	int head;
+} tTraceStep;
+
+/**
+ * Runs the machine on the tape like eval_sorting_fitness() does, but step by step,
+ * and appends the section of the tape to the trace, if it's not NULL.
+ * @return the fitness, the final tape is left in work_tape
+ */
+double replay(tTransitions * t, tTape * orig_tape, tTape * work_tape, FILE * trace);
+double sorting_fitness_bound(tTape * orig_tape);
+/**
+ * The recorded runs of a parent on all the sample tapes, its kids are resumed
+ * from the checkpoints instead of running from the start.
+ */
+typedef struct {
+	tTransTableItem * table;	// copy of the parent's table
+	int valid;					// 0 until the runs are recorded
+	tRunCheckpoints * runs;		// [nr_of_tapes]
+	double * fitness;			// [nr_of_tapes]
+} tParentRun;
+
+// @return the recorded runs of n parents for the current thread, their valid flags are reset
+tParentRun * get_parent_runs(int n, tParams * params, int nr_of_tapes);
+// records the runs of the parent's table on all the sample tapes, with checkpoints
+void record_parent_run(tParentRun * p, tTransTableItem * parent, tParams * params, tTape * orig_tapes, int n);
+// clears t->used before the evaluation, or marks all the items as used, when it can't be known
+inline void reset_used(tTransitions * t, int all);
+
+/**
+ * Evaluates without the tape log, resumed from the parent's checkpoints, if parent is not NULL.
+ * Stops as soon as the best possible sum of the remaining tapes can't reach the threshold.
+ * @return the same value as eval_sorting_fitness_n_tapes(), or FITNESS_REJECTED
+ */
+double eval_sorting_fitness_bounded(tTransitions * t, tParentRun * parent, tTape * orig_tapes, int n,
+		double threshold);
+/**
+ * Evaluates n machines with the batch engine, fitness[i] gets the result of t[i],
+ * the same value as eval_sorting_fitness_bounded() would return.
+ * @param parents NULL, or the recorded parent's runs for each machine to resume from
+ */
+void eval_sorting_fitness_batch(tTransitions * t, int n, tTape * orig_tapes, int nr_of_tapes,
+		tParentRun ** parents, double threshold, double * fitness);
+/**
+ * Selects the mutation and the genome hash specialized for the shape of the run's machines,
+ * if it's one of KERNEL_SHAPES. Called once, before the evolution.
+ */
+void set_kernels(int states, int symbols);
+/**
+ * Staged evaluation of the kids, which have a threshold (early abort): first the shortest
+ * sample tape up to screen_steps, only the best screen_pass % of the kids (ranked among
+ * the last SCREEN_WINDOW ones) go on to all the tapes, raced against the threshold,
+ * the others get FITNESS_REJECTED. The fitness of the kids which pass is the exact one.
+ * Called once, before the evolution.
+ */
+void set_screening(tParams * params, tTape * orig_tapes, int n);
+/**
+ * Prints the memory taken by the populations (and their queues and checkpoints) of the given nr. of threads.
+ */
+void print_memory_footprint(tParams * params, int nr_of_tapes, int threads);
+/**
+ * Evolves the population of the calling thread (with work stealing, the only population).
+ * @return 0 after params->generations, never if it's 0
+ */
 int evolve_turing(tParams * params, tTape * orig_tapes, int nr_of_tapes);
 
 
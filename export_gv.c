@@ -0,0 +1,151 @@
+/**
+ * Renders the records of a results log (OUTPUT/results.jsonl) as the graphs of the
+ * transition tables, OUTDIR/FITNESS-THREAD-GENERATION-RESTARTS.gv, each with the table
+ * and the sample tapes sorted by the machine in the .gv.txt file next to it.
+ * The machines are run again, the evolution doesn't log the tapes. With -t, each
+ * run is also traced step by step into the .gv.trace file, see trace2txt.c.
+ *
+ * gcc -std=gnu99 -fgnu89-inline -O2 -fopenmp export_gv.c arena.c checkpoint.c cluster.c dpqueue.c evolve_turing.c \
+ *     fitness_cache.c island.c pqueue.c prng.c results.c snapshot.c stats.c turing.c turing_batch.c turing_jit.c rle_tape.c samples.c \
+ *     -o export_gv -lm -lpthread
+ * ./export_gv [-t] [RESULTS [OUTDIR]]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "common.h"
+#include "turing.h"
+#include "evolve_turing.h"
+#include "samples.h"
+
+#define LINE_MAX_LEN (1<<20)
+
+volatile int log_level=LOG_NONE_0;
+int trace;	// -t
+
+// the number after "key": in the line, 0 if it's not there
+static double field(char * line, char * key) {
+	char pattern[64], * p;
+
+	snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+	return (p=strstr(line, pattern)) ? strtod(p+strlen(pattern), NULL) : 0;
+}
+
+// @return the nr. of table items parsed
+static int parse_table(char * line, tTransTableItem * table, int table_size) {
+	char * p=strstr(line, "\"table\":[");
+	int i, state, symbol, shift, len;
+
+	if (p==NULL) return 0;
+	p+=strlen("\"table\":[");
+	for (i=0; i<table_size; i++, p+=len) {
+		if (sscanf(p, "%*[,][%d,%d,%d]%n", &state, &symbol, &shift, &len)<3 &&
+				sscanf(p, "[%d,%d,%d]%n", &state, &symbol, &shift, &len)<3)
+			break;
+		table[i]=TRANS_ITEM(state, symbol, shift);
+	}
+	return i;
+}
+
+static void export(tTransTableItem * t, double fitness, int thread_id, ulong generation, ulong restarts,
+		tParams * params, char * outdir) {
+	int st, sy, i, j, len;
+	unsigned long ulong_fit;
+	char fname [4096];
+	FILE * f, *ft, * tr=NULL;
+	tTransitions trans={params->states, params->symbols, t};
+	tTraceHeader header={TRACE_MAGIC, params->states, params->symbols, NR_OF_SAMPLE_TAPES};
+	static tTape work;
+
+	if (fitness < ULONG_MAX/1e9)
+		ulong_fit=1e8*fitness;
+	else
+		ulong_fit=ULONG_MAX;
+	len=snprintf(fname, sizeof(fname)-8, "%s/%.9lu-%d-%lu-%lu.gv",
+			outdir, ulong_fit, thread_id, generation, restarts);
+	if ( (f=fopen(fname, "w"))==NULL ||
+		 (ft=fopen(strcat(fname,".txt"), "w"))==NULL ||
+		 (trace && (tr=fopen(strcpy(fname+len, ".trace")-len, "w"))==NULL)) {
+		fprintf(stderr, "Error: Can't open file for new graph, exiting.\n");
+		exit(EXIT_FAILURE);
+	}
+	if (tr) {
+		fwrite(&header, sizeof(header), 1, tr);
+		fwrite(t, sizeof(tTransTableItem), params->states*params->symbols, tr);
+	}
+	fprintf(f,
+		"digraph \"Finite state machine, fitness=%.6lf, "
+				  "population_size=%d, states=%d, symbols=%d, "
+				  "best_cnt=%d, kids_cnt=%d\" {\n"
+		"	rankdir=LR;\n"
+		"	size=\"8,5\"\n"
+		"S12 [shape=doublecircle];\n"
+		"	node [shape = circle];\n",
+		fitness,
+		params->population_size, params->states, params->symbols,
+		params->best_cnt, params->kids_cnt
+	);
+	for (st=0; st<params->states; st++)			// for all their states
+		for (sy=0; sy<params->symbols; sy++, t++)	{// for all their symbols
+			fprintf(ft, "{ %d, %d, %d },\n", TRANS_STATE(*t), TRANS_SYMBOL(*t), TRANS_SHIFT(*t));
+			fprintf(f, "	S%d -> S%d [ label = \"%d / %d, %s\" ];\n",
+						st, TRANS_STATE(*t), sy, TRANS_SYMBOL(*t), shift2str(TRANS_SHIFT(*t)));
+		}
+	fprintf(f, "}\n");
+	fprintf(ft, "Tape content:\n");
+	for (i=0; i<NR_OF_SAMPLE_TAPES; i++) {	// the tapes sorted by the machine
+		replay(&trans, &Sample_tapes[i], &work, tr);
+		for (j=0; j<work.input_len; j++)
+			fprintf(ft, "%d,", work.content[j]);
+		fprintf(ft, "\n");
+	}
+	fclose(f);
+	fclose(ft);
+	if (tr) fclose(tr);
+}
+
+int main(int argc, char * argv[]) {
+	char * path, * outdir, * line, * slash;
+	tParams params={0};
+	tTapeMetrics metrics[NR_OF_SAMPLE_TAPES];
+	tTransTableItem * table=NULL;
+	int table_size=0, exported=0;
+	FILE * f;
+
+	if (argc>1 && strcmp(argv[1], "-t")==0) {
+		trace=1;
+		argc--, argv++;
+	}
+	path=argc>1 ? argv[1] : "output/results.jsonl";
+	if ((f=fopen(path, "r"))==NULL) {
+		fprintf(stderr, "Can't open %s!\n", path);
+		return EXIT_FAILURE;
+	}
+	if (argc>2) outdir=argv[2];
+	else if ((slash=strrchr(outdir=strdup(path), '/'))!=NULL) *slash=0;
+	else outdir=".";
+	line=malloc(LINE_MAX_LEN);
+	calc_all_tapes_metrics(Sample_tapes, metrics, NR_OF_SAMPLE_TAPES);
+	while (fgets(line, LINE_MAX_LEN, f)) {
+		if (strstr(line, "\"run\":")) {	// the parameters of the records which follow
+			params.population_size=field(line, "population_size");
+			params.states=field(line, "states");
+			params.symbols=field(line, "symbols");
+			params.best_cnt=field(line, "best_cnt");
+			params.kids_cnt=field(line, "kids_cnt");
+			loop_check=strstr(line, "\"loop_check\":") ? field(line, "loop_check") : 1;
+			set_turing_engine(field(line, "engine"), params.states, params.symbols);
+			table_size=params.states*params.symbols;
+			table=realloc(table, table_size*sizeof(tTransTableItem));
+		} else if (table_size==0 || parse_table(line, table, table_size)!=table_size) {
+			fprintf(stderr, "Skipping a record without its run or with an incomplete table\n");
+		} else {
+			export(table, field(line, "fitness"), field(line, "thread"), field(line, "generation"),
+					field(line, "restarts"), &params, outdir);
+			exported++;
+		}
+	}
+	printf("%d graphs exported to %s\n", exported, outdir);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "turing.h"
+#include "fitness_cache.h"
+
+tFitnessCache * fitness_cache=NULL;
+
+tFitnessCache * fitness_cache_init(ulong size) {
+	tFitnessCache * c;
+	ulong buckets=1;
+
+	while (buckets*CACHE_WAYS < size) buckets*=2;
+	if ((c=calloc(1, sizeof(tFitnessCache)))==NULL)
+		return NULL;
+	c->buckets=buckets;
+	c->slots=calloc(buckets*CACHE_WAYS, sizeof(tCacheSlot));
+	c->referenced=calloc(buckets*CACHE_WAYS, 1);
+	c->hand=calloc(buckets, 1);
+	if (c->slots==NULL || c->referenced==NULL || c->hand==NULL) {
+		fitness_cache_free(c);
+		return NULL;
+	}
+	return c;
+}
+
+void fitness_cache_free(tFitnessCache * c) {
+	free(c->slots);
+	free(c->referenced);
+	free(c->hand);
+	free(c);
+}
+
+#define MIX(h) ((h) ^= (h) >> 32, (h) *= 0xD6E8FEB86659FD93UL, (h) ^= (h) >> 32)
+
+// the body of genome_hash(), size is a constant in the kernels of KERNEL_SHAPES
+static inline __attribute__((always_inline)) ulong hash_table(tTransTableItem * table, int size) {
+	uchar * p=(uchar *)table, * end=p+size*sizeof(tTransTableItem);
+	ulong h=size*0x9E3779B97F4A7C15UL, w;
+
+	for (; p+sizeof(w) <= end; p+=sizeof(w)) {
+		memcpy(&w, p, sizeof(w));
+		h^=w;
+		MIX(h);
+	}
+	for (w=0; p<end; p++) w=w<<8 | *p;
+	h^=w;
+	MIX(h);
+	return h > CACHE_BUSY ? h : h+CACHE_BUSY+1;
+}
+
+ulong genome_hash(tTransTableItem * table, int size) {
+	return hash_table(table, size);
+}
+
+#define HASH_KERNEL(STATES, SYMBOLS) \
+static ulong genome_hash_##STATES##x##SYMBOLS(tTransTableItem * table, int size) { \
+	return size==STATES*SYMBOLS ? hash_table(table, STATES*SYMBOLS) : hash_table(table, size); \
+}
+KERNEL_SHAPES(HASH_KERNEL)
+#undef HASH_KERNEL
+
+tGenomeHash genome_hash_kernel(int size) {
+#define SELECT_KERNEL(STATES, SYMBOLS) \
+	if (size==STATES*SYMBOLS) return genome_hash_##STATES##x##SYMBOLS;
+	KERNEL_SHAPES(SELECT_KERNEL)
+#undef SELECT_KERNEL
+	return genome_hash;
+}
+
+int fitness_cache_get(tFitnessCache * c, ulong hash, double * fitness) {
+	ulong i=(hash & (c->buckets-1))*CACHE_WAYS, end=i+CACHE_WAYS;
+	tCacheSlot * slot;
+	double f;
+
+	for (slot=c->slots+i; i<end; i++, slot++)
+		if (__atomic_load_n(&slot->key, __ATOMIC_ACQUIRE)==hash) {
+			__atomic_load(&slot->fitness, &f, __ATOMIC_RELAXED);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&slot->key, __ATOMIC_RELAXED)!=hash) break;
+			__atomic_store_n(c->referenced+i, 1, __ATOMIC_RELAXED);
+			__atomic_fetch_add(&c->hits, 1, __ATOMIC_RELAXED);
+			*fitness=f;
+			return 1;
+		}
+	__atomic_fetch_add(&c->misses, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+void fitness_cache_put(tFitnessCache * c, ulong hash, double fitness) {
+	ulong bucket=hash & (c->buckets-1), first=bucket*CACHE_WAYS, i, key;
+	int way, victim=-1;
+
+	// an empty slot first, then the clock hand looks for a slot not referenced since its last pass
+	for (way=0; way<CACHE_WAYS; way++) {
+		key=__atomic_load_n(&c->slots[first+way].key, __ATOMIC_RELAXED);
+		if (key==hash) return;		// another thread was faster
+		if (key==CACHE_EMPTY && victim<0) victim=way;
+	}
+	for (way=0; way<2*CACHE_WAYS && victim<0; way++) {
+		i=first + __atomic_fetch_add(c->hand+bucket, 1, __ATOMIC_RELAXED) % CACHE_WAYS;
+		if (__atomic_exchange_n(c->referenced+i, 0, __ATOMIC_RELAXED)==0) victim=i-first;
+	}
+	if (victim<0) return;
+	i=first+victim;
+	key=__atomic_load_n(&c->slots[i].key, __ATOMIC_RELAXED);
+	if (key==CACHE_BUSY ||
+		!__atomic_compare_exchange_n(&c->slots[i].key, &key, CACHE_BUSY, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+		return;		// somebody else is writing there, never mind
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store(&c->slots[i].fitness, &fitness, __ATOMIC_RELAXED);
+	__atomic_store_n(c->referenced+i, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&c->slots[i].key, hash, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&c->inserts, 1, __ATOMIC_RELAXED);
+	if (key!=CACHE_EMPTY) __atomic_fetch_add(&c->evictions, 1, __ATOMIC_RELAXED);
+}
+
+void fitness_cache_print(tFitnessCache * c, FILE * out) {
+	ulong hits=c->hits, misses=c->misses;
+	fprintf(out, "Fitness cache: size=%lu, hits=%lu, misses=%lu (%.1lf%% hits), inserts=%lu, evictions=%lu\n",
+			c->buckets*CACHE_WAYS, hits, misses, hits+misses ? 100.0*hits/(hits+misses) : 0.0,
+			c->inserts, c->evictions);
+}
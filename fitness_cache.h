@@ -0,0 +1,53 @@
+#ifndef FITNESS_CACHE_H
+#define FITNESS_CACHE_H
+
+#include <stdio.h>
+#include "turing.h"
+
+#define CACHE_WAYS 4		// slots per bucket
+#define CACHE_DEFAULT_SIZE (1<<20)
+
+/**
+ * Fixed size, lock-free cache of genome hash -> fitness, shared by all the threads.
+ * It's 4-way set associative, a full bucket evicts by the clock (second chance) policy.
+ * A writer locks a slot by CAS of its key to CACHE_BUSY, readers check the key
+ * before and after reading the fitness, so they never see a half written slot.
+ */
+typedef struct {
+	ulong key;				// genome hash, CACHE_EMPTY or CACHE_BUSY
+	double fitness;
+} tCacheSlot;
+
+enum {CACHE_EMPTY, CACHE_BUSY};
+
+typedef struct {
+	tCacheSlot * slots;
+	uchar * referenced;		// clock bits of the slots
+	uchar * hand;			// clock hand of each bucket
+	ulong buckets;			// power of 2
+	ulong hits, misses, inserts, evictions;
+} tFitnessCache;
+
+extern tFitnessCache * fitness_cache;	// NULL = no caching
+
+/**
+ * @param size the nr. of cached fitness values, rounded up to a power of 2
+ * @return the cache or NULL for insufficient memory
+ */
+tFitnessCache * fitness_cache_init(ulong size);
+void fitness_cache_free(tFitnessCache * c);
+ulong genome_hash(tTransTableItem * table, int size);
+typedef ulong (*tGenomeHash)(tTransTableItem * table, int size);
+/**
+ * @return genome_hash() specialized for the tables of this size (see KERNEL_SHAPES),
+ * 		   which still hashes the others right
+ */
+tGenomeHash genome_hash_kernel(int size);
+/**
+ * @return 1 and the fitness for the known hash, 0 otherwise
+ */
+int fitness_cache_get(tFitnessCache * c, ulong hash, double * fitness);
+void fitness_cache_put(tFitnessCache * c, ulong hash, double fitness);
+void fitness_cache_print(tFitnessCache * c, FILE * out);
+
+#endif
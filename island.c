@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include "island.h"
+#include "prng.h"
+
+tIslands * islands=NULL;
+
+#define ring(is, to, from)	((is)->rings+(to)*(is)->n+(from))
+#define slot(is, r, i)		((r)->slots+((i) & (MIGRATION_SLOTS-1))*(is)->slot_size)
+
+tIslands * islands_init(int n, tTopology topology, int table_size) {
+	tIslands * is;
+	int to, from;
+
+	if ((is=calloc(1, sizeof(tIslands)))==NULL)
+		return NULL;
+	is->n=n;
+	is->topology=topology;
+	is->table_size=table_size;
+	is->used_words=USED_WORDS(table_size);
+	is->slot_size=(sizeof(double)+is->used_words*sizeof(ulong)+table_size*sizeof(tTransTableItem)+7) & ~7UL;
+	is->best=-DBL_MAX;
+	if (posix_memalign((void **)&is->rings, 64, n*n*sizeof(tMigrationRing))) {
+		free(is);
+		return NULL;
+	}
+	memset(is->rings, 0, n*n*sizeof(tMigrationRing));
+	for (to=0; to<n; to++)
+		for (from=0; from<n; from++)
+			if (from!=to && (topology==TOPOLOGY_RANDOM || (from+1)%n==to) &&
+					(ring(is, to, from)->slots=malloc(MIGRATION_SLOTS*is->slot_size))==NULL) {
+				islands_free(is);
+				return NULL;
+			}
+	return is;
+}
+
+void islands_free(tIslands * is) {
+	int i;
+
+	for (i=0; i<is->n*is->n; i++) free(is->rings[i].slots);
+	free(is->rings);
+	free(is);
+}
+
+int island_send(tIslands * is, int from, tTransTableItem * table, ulong * used, double fitness) {
+	int to=is->topology==TOPOLOGY_RING ? (from+1)%is->n : (from+1+prng_below(is->n-1))%is->n;
+	tMigrationRing * r=ring(is, to, from);
+	ulong tail=r->tail;
+	char * s;
+
+	if (tail-__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == MIGRATION_SLOTS) {
+		__atomic_fetch_add(&is->lost, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	s=slot(is, r, tail);
+	memcpy(s, &fitness, sizeof(double));
+	memcpy(s+sizeof(double), used, is->used_words*sizeof(ulong));
+	memcpy(s+sizeof(double)+is->used_words*sizeof(ulong), table, is->table_size*sizeof(tTransTableItem));
+	__atomic_store_n(&r->tail, tail+1, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&is->sent, 1, __ATOMIC_RELAXED);
+	return 1;
+}
+
+int island_receive(tIslands * is, int to, tTransTableItem * table, ulong * used, double * fitness) {
+	tMigrationRing * r;
+	ulong head;
+	int from;
+	char * s;
+
+	for (from=0; from<is->n; from++) {
+		r=ring(is, to, from);
+		if (r->slots==NULL || (head=r->head)==__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+			continue;
+		s=slot(is, r, head);
+		memcpy(fitness, s, sizeof(double));
+		memcpy(used, s+sizeof(double), is->used_words*sizeof(ulong));
+		memcpy(table, s+sizeof(double)+is->used_words*sizeof(ulong), is->table_size*sizeof(tTransTableItem));
+		__atomic_store_n(&r->head, head+1, __ATOMIC_RELEASE);
+		__atomic_fetch_add(&is->received, 1, __ATOMIC_RELAXED);
+		return 1;
+	}
+	return 0;
+}
+
+int island_best_update(tIslands * is, double fitness) {
+	double best;
+
+	__atomic_load(&is->best, &best, __ATOMIC_RELAXED);
+	while (fitness > best)
+		if (__atomic_compare_exchange(&is->best, &best, &fitness, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			return 1;
+	return 0;
+}
+
+void islands_print(tIslands * is, FILE * out) {
+	fprintf(out, "Islands: %d, topology=%s, best fitness=%.6lf, migrants sent=%lu, received=%lu, lost=%lu\n",
+			is->n, is->topology==TOPOLOGY_RING ? "ring" : "random", is->best, is->sent, is->received, is->lost);
+}
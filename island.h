@@ -0,0 +1,62 @@
+#ifndef ISLAND_H
+#define ISLAND_H
+
+#include <stdio.h>
+#include "turing.h"
+
+#define MIGRATION_SLOTS 16		// per ring, power of 2
+
+typedef enum {TOPOLOGY_NONE, TOPOLOGY_RING, TOPOLOGY_RANDOM, TOPOLOGIES} tTopology;
+
+/**
+ * Single producer, single consumer ring of migrants from one thread to another.
+ * Only the producer writes tail, only the consumer writes head, each on its own cache line.
+ */
+typedef struct {
+	ulong tail;
+	char pad1[64-sizeof(ulong)];
+	ulong head;
+	char pad2[64-sizeof(ulong)];
+	char * slots;			// [MIGRATION_SLOTS], NULL for the edges not in the topology
+} tMigrationRing;
+
+/**
+ * The threads as islands: every migration interval, a thread sends its best individuals
+ * to its neighbour(s) and takes in the ones sent to it. Migrants don't wait for a full
+ * ring, they are lost then.
+ */
+typedef struct {
+	int n, table_size, used_words;
+	tTopology topology;		// ring: thread i sends to i+1, random: to any other thread
+	size_t slot_size;		// fitness, table, used bitmap
+	tMigrationRing * rings;	// [n*n], rings[to*n+from]
+	double best;			// the best fitness of all the islands
+	ulong sent, received, lost;
+} tIslands;
+
+extern tIslands * islands;	// NULL = the threads evolve independently
+
+/**
+ * @param n the nr. of threads
+ * @return the islands or NULL for insufficient memory
+ */
+tIslands * islands_init(int n, tTopology topology, int table_size);
+void islands_free(tIslands * is);
+/**
+ * Sends the individual from the thread to its neighbour in the topology.
+ * @return 0 if the neighbour's ring is full
+ */
+int island_send(tIslands * is, int from, tTransTableItem * table, ulong * used, double fitness);
+/**
+ * Takes in one of the individuals sent to the thread.
+ * @return 0 if there's none
+ */
+int island_receive(tIslands * is, int to, tTransTableItem * table, ulong * used, double * fitness);
+/**
+ * Atomically raises the best fitness of all the islands.
+ * @return 1 if fitness is a new best of all the islands
+ */
+int island_best_update(tIslands * is, double fitness);
+void islands_print(tIslands * is, FILE * out);
+
+#endif
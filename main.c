@@ -4,116 +4,185 @@
 #include <omp.h>
 #include <signal.h>
 #include <ctype.h>
+#include <time.h>
 #include "common.h"
 #include "turing.h"
 #include "evolve_turing.h"
-#include "pqueue.h"
+#include "dpqueue.h"
+#include "fitness_cache.h"
+#include "island.h"
+#include "cluster.h"
+#include "snapshot.h"
+#include "results.h"
+#include "stats.h"
+#include "samples.h"
 
-
-#define TAPE_LEN 1000
-typedef enum {
-	start, was_1, was_2, was_3,  s2_1,  s3_1,  s3_2, was_2_swap, was_3_swap, search_blank, error, end
-} tDemoBubbleStates;
-
-
-tTransTableItem demoBubbleTable[]={
-	// 0=start:	BLANK		1			2				3
-	  {end, E, N}, {was_1, E, R}, {was_2, E, R}, {was_3, E, R} ,
-	// 1=was_1:	BLANK		1			2				3
-	  {end, E, N}, {was_1, E, R}, {was_2, E, R}, {was_3, E, R} ,
-	// 2=was_2:	BLANK		1			2				3
-	  {end, E, N}, { s2_1, 2, L}, {was_2, E, R}, {was_3, E, R} ,
-	// 3=was_3:	BLANK		1			2				3
-	  {end, E, N}, { s3_1, 3, L}, { s3_2, 3, L}, {was_3, E, R} ,
-	// 4=s2_1:	BLANK		1			2				3
-	  {error, E, N}, {error, E, N}, {was_2_swap, 1, RR} , {error, E, N},
-	// 5=s3_1:	BLANK		1			2				3
-	  {error, E, N}, {error, E, N}, {error, E, N}, {was_3_swap, 1, RR} ,
-	// 6=s3_2:	BLANK		1			2				3
-	  {error, E, N}, {error, E, N}, {error, E, N}, {was_3_swap, 2, RR} ,
-	// 7=was_2_swap:BLANK		1			2				3
-	  {search_blank, E, L}, { s2_1, 2, L}, {was_2_swap, E, R},  {was_3_swap, E, R} ,
-	// 8=was_3_swap:BLANK		1			2				3
-	  {search_blank, E, L}, { s3_1, 3, L}, { s3_2, 3, L},  {was_3_swap, E, R} ,
-	// 9=search_blank:	BLANK		1			2				3
-	  {start, E, R}, {search_blank, E, L}, {search_blank, E, L}, {search_blank, E, L} 
-	// 10=error (final state)
-	// 11=end (final state)
-};
-
-#define DEMOBUBBLE_SYMBOLS 4
-tTransitions demoBubble = {	
-		sizeof(demoBubbleTable)/sizeof(tTransTableItem)/DEMOBUBBLE_SYMBOLS,
-		//=10,									// nr. of states
-	DEMOBUBBLE_SYMBOLS,					// nr. of symbols
-	demoBubbleTable 					// transition table
-};
-
-tTape Sample_tapes[] = {
-		{SAMPLE_TAPE1, sizeof((char[])SAMPLE_TAPE1)},
-		{SAMPLE_TAPE2, sizeof((char[])SAMPLE_TAPE2)},
-		{SAMPLE_TAPE3, sizeof((char[])SAMPLE_TAPE3)},
-};
+int rle_min_len=0;	// the sample tapes of at least this length run-length encoded, 0=none
 
 void help_exit(char * progname) {
-	printf("%s [-b NR_OF_BESTS] [-k NR_OF_KIDS] [-o OUTPUT] [-p POPULATION_SIZE] "
-			"[-s STATES] [-y SYMBOLS]\nwhere:\n"
+	printf("%s [-a EARLY_ABORT] [-b NR_OF_BESTS] [-c CACHE_SIZE] [-e ENGINE] [-g MIGRATION_INTERVAL] [-i CHECKPOINT_INTERVAL] [-k NR_OF_KIDS] [-l LOOP_CHECK] [-m PAGES] [-n MIGRANTS] [-o OUTPUT] [-p POPULATION_SIZE] "
+			"[-s STATES] [-t TOPOLOGY] [-w WORK_STEALING] [-y SYMBOLS] [--seed SEED] "
+			"[--coordinator ADDRESS | --worker ADDRESS] [--snapshot SECONDS] [--resume] [--generations GENERATIONS] [--stats SECONDS] [--sweeps SWEEPS] [--rle CELLS] [--screen PERCENT] [--screen-steps STEPS]\nwhere:\n"
+			"-a EARLY_ABORT\n	1 stops the evaluation of a kid as soon as it can't beat the individual it replaces, 0 evaluates all. Default is 1\n"
 			"-b BEST_CNT\n	sets the number of best individuals, who are evolved. Default is 5000\n"
+			"-c CACHE_SIZE\n	sets the number of fitness values cached for all the threads, 0 disables the cache. Default is %d\n"
 			"-d DEGENARTION_CNT\n	if this number generations has no success, then the evolution is restarted. Default is 500\n"
+			"-e ENGINE\n	selects the Turing machine simulator: 0=reference, 1=fast, 2=batch (SIMD lockstep), 3=jit (the runs longer than %d steps continue as x86-64 code). Default is 1\n"
+			"-g MIGRATION_INTERVAL\n	the islands exchange individuals every MIGRATION_INTERVAL generations. Default is 10\n"
+			"-i CHECKPOINT_INTERVAL\n	records the parents' runs with checkpoints every CHECKPOINT_INTERVAL steps (at least 1/%d of the step limit),\n"
+			"	the kids are then resumed from the checkpoint before their first changed transition. Default is 0=off\n"
 			"-k KIDS_CNT\n	sets the number of kids of the best individual. Default is 10\n"
+			"-l LOOP_CHECK\n	1 stops the simulation of machines which repeat a configuration, 0 runs them to the step limit. Default is 1\n"
+			"-m PAGES\n	memory pages of the populations: 0=normal, 1=transparent huge pages, 2=reserved huge pages (hugetlbfs). Default is 1\n"
+			"-n MIGRANTS\n	sets the number of best individuals, who migrate from each island. Default is 5\n"
 			"-p POPULATION_SIZE\n	sets the population size. Default value is 10000\n"
-			"-s STATES\n	sets the number of Turing machine states. Default value is 12\n"
-			"-y SYMBOLS\n	sets the number of Turing machine symbols. Default value is 4\n"
-			"-o OUTPUT\n	output directory. Default is \"output\"\n", progname);
+			"-s STATES\n	sets the number of Turing machine states, at most %d. Default value is 12\n"
+			"-t TOPOLOGY\n	0=the threads evolve independently, islands where the threads send their best individuals: 1=to the next thread,\n"
+			"	2=to a random thread. Only new bests of all the islands are recorded then. Default is 0\n"
+			"-w WORK_STEALING\n	1 evolves a single population, the kids of each generation are evaluated by all the threads,\n"
+			"	0 evolves a population in each thread. Default is 0\n"
+			"-y SYMBOLS\n	sets the number of Turing machine symbols, at most %d. Default value is 4\n"
+			"-o OUTPUT\n	output directory, the new best individuals are appended to OUTPUT/results.jsonl (see export_gv). Default is \"output\"\n"
+			"--seed SEED\n	seeds the random numbers. The same seed and nr. of threads (OMP_NUM_THREADS) repeat the run exactly,\n"
+			"	with more threads only without the shared cache (-c 0) and islands (-t 0): the same results.jsonl records,\n"
+			"	but their times. Default is the current time\n"
+			"--coordinator ADDRESS\n	serves the workers at ADDRESS (host:port, :port or a Unix socket path with a '/'), instead of evolving:\n"
+			"	keeps the best individuals they send and sends them back to the other workers\n"
+			"--worker ADDRESS\n	evolves as a worker of the coordinator at ADDRESS: every MIGRATION_INTERVAL generations, each thread\n"
+			"	sends its MIGRANTS best individuals and takes in as many from the other workers.\n"
+			"	STATES and SYMBOLS must be the coordinator's. Without the coordinator, the evolution goes on alone\n"
+			"--snapshot SECONDS\n	saves the state of each thread to OUTPUT/state-THREAD.bin every SECONDS, 0=never. Default is %d\n"
+			"--resume\n	continues the evolution saved in OUTPUT, with its parameters and nr. of threads\n"
+			"--generations GENERATIONS\n	stops the evolution at this generation, 0=never. Default is 0\n"
+			"--stats SECONDS\n	appends the runtime counters of all the threads to OUTPUT/stats.csv every SECONDS, 0=only on SIGUSR1,\n"
+			"	which prints them, too. Default is %d\n"
+			"--sweeps SWEEPS\n	1 runs the moves of a state over a run of its symbol at once (fast engine), 0 step by step. Default is 1\n"
+			"--rle CELLS\n	evaluates the sample tapes of at least CELLS cells on their run-length encoded copies, whose cost\n"
+			"	follows the number of runs instead of cells, 0=none. Default is 0\n"
+			"--screen PERCENT\n	with the early abort, the kids run on the shortest tape up to the screening step limit first,\n"
+			"	only the best PERCENT of them (by the rank among the last %d) are evaluated on all the tapes, 0=all. Default is 0\n"
+			"--screen-steps STEPS\n	the step limit of the screening run. Default is %d\n", progname, CACHE_DEFAULT_SIZE, JIT_HOT_STEPS, CHECKPOINTS_MAX,
+			TRANS_MAX_STATES, TRANS_MAX_SYMBOLS, SNAPSHOT_DEFAULT_INTERVAL, STATS_DEFAULT_INTERVAL,
+			SCREEN_WINDOW, SCREEN_DEFAULT_STEPS);
 	exit(EXIT_SUCCESS);
 }
 
 /**
  * @TODO Add options for:
  *  - sample tapes. They would be part of tParams type. Result=lots of simplification
- *  - importing good individuals for starting evolution where we ended
  */
 void get_options(int argc, char ** argv, tParams * params) {
 	int i;
 	long val;
 	char * arg, * endptr;
-	enum {best, degeneration, kids, output, popul_size, states, symbols} arg_type=popul_size;
+	enum {abort_eval, best, cache, checkpoint, degeneration, coordinator, engine, generations, kids, loop, migrants, migration, pages, output, popul_size, seed, snapshot, states, stats_interval, sweeps_arg, rle, screen, screen_steps, symbols, topology, work_stealing, worker} arg_type=popul_size;
 	for (i=1; i<argc; i++) {
 		arg=argv[i];
 		if (arg[0]=='-')
 			switch (arg[1]) {
+				case 'a': arg_type=abort_eval; break;
 				case 'b': arg_type=best; break;
+				case 'c': arg_type=cache; break;
 				case 'd': arg_type=degeneration; break;
+				case 'e': arg_type=engine; break;
+				case 'g': arg_type=migration; break;
+				case 'i': arg_type=checkpoint; break;
 				case 'k': arg_type=kids; break;
+				case 'l': arg_type=loop; break;
+				case 'm': arg_type=pages; break;
+				case 'n': arg_type=migrants; break;
 				case 'o': arg_type=output; break;
 				case 'p': arg_type=popul_size; break;
 				case 's': arg_type=states; break;
+				case 't': arg_type=topology; break;
+				case 'w': arg_type=work_stealing; break;
 				case 'y': arg_type=symbols; break;
+				case '-':
+					if (!strcmp(arg, "--seed")) arg_type=seed;
+					else if (!strcmp(arg, "--coordinator")) arg_type=coordinator;
+					else if (!strcmp(arg, "--worker")) arg_type=worker;
+					else if (!strcmp(arg, "--snapshot")) arg_type=snapshot;
+					else if (!strcmp(arg, "--resume")) params->resume=1;
+					else if (!strcmp(arg, "--generations")) arg_type=generations;
+					else if (!strcmp(arg, "--stats")) arg_type=stats_interval;
+					else if (!strcmp(arg, "--sweeps")) arg_type=sweeps_arg;
+					else if (!strcmp(arg, "--rle")) arg_type=rle;
+					else if (!strcmp(arg, "--screen")) arg_type=screen;
+					else if (!strcmp(arg, "--screen-steps")) arg_type=screen_steps;
+					else help_exit(argv[0]);
+					break;
 			default:
 				help_exit(argv[0]);
 			}
 		else {
 			if (arg_type==output)
 				params->output=arg;
+			else if (arg_type==coordinator)
+				params->coordinator=arg;
+			else if (arg_type==worker)
+				params->worker=arg;
 			else {
+				if (arg_type==seed || arg_type==generations) {
+					*(arg_type==seed ? &params->seed : &params->generations)=strtoul(arg, &endptr, 10);
+					if (endptr==arg) help_exit(argv[0]);
+					continue;
+				}
 				val=strtol(arg, &endptr, 10);
 				if (endptr==arg) help_exit(argv[0]);
 				switch (arg_type) {
 					case popul_size: params->population_size=val; break;
-					case symbols: params->symbols=val; break;
-					case states: params->states=val; break;
+					case symbols:
+						if (val<1 || val>TRANS_MAX_SYMBOLS) help_exit(argv[0]);
+						params->symbols=val; break;
+					case states:
+						if (val<1 || val>TRANS_MAX_STATES) help_exit(argv[0]);
+						params->states=val; break;
 					case kids: params->kids_cnt=val; break;
 					case best: params->best_cnt=val; break;
-					case degeneration: params->degeneration_cnt=val; break;					default:;
+					case degeneration: params->degeneration_cnt=val; break;
+					case engine:
+						if (val<0 || val>=ENGINES) help_exit(argv[0]);
+						params->engine=val; break;
+					case loop: loop_check=val; break;
+					case sweeps_arg: sweeps=val; break;
+					case rle: rle_min_len=val; break;
+					case cache: params->cache_size=val; break;
+					case checkpoint: params->checkpoint_interval=val; break;
+					case abort_eval: params->early_abort=val; break;
+					case pages:
+						if (val<PAGES_NORMAL || val>PAGES_HUGETLB) help_exit(argv[0]);
+						params->pages=val; break;
+					case topology:
+						if (val<TOPOLOGY_NONE || val>=TOPOLOGIES) help_exit(argv[0]);
+						params->topology=val; break;
+					case migration:
+						if (val<1) help_exit(argv[0]);
+						params->migration_interval=val; break;
+					case migrants: params->migrants=val; break;
+					case work_stealing: params->work_stealing=val; break;
+					case snapshot: params->snapshot_interval=val; break;
+					case stats_interval: params->stats_interval=val; break;
+					case screen:
+						if (val<0 || val>100) help_exit(argv[0]);
+						params->screen_pass=val; break;
+					case screen_steps:
+						if (val<1) help_exit(argv[0]);
+						params->screen_steps=val; break;
+					default:;
 				}	// switch (arg_type)
 			}
 		} // else
 	} // for
-	printf("Parameters: population size=%d, states=%d, symbols=%d, best_cnt=%d, kids_cnt=%d, degeneration_cnt=%d\n",
-			params->population_size, params->states, params->symbols, params->best_cnt, params->kids_cnt, params->degeneration_cnt);
+	printf("Parameters: population size=%d, states=%d, symbols=%d, best_cnt=%d, kids_cnt=%d, degeneration_cnt=%d, engine=%d, loop_check=%d, sweeps=%d, rle=%d, cache_size=%ld, checkpoint_interval=%d, early_abort=%d, pages=%d, seed=%lu, topology=%d, migration_interval=%d, migrants=%d, work_stealing=%d, snapshot_interval=%d, generations=%lu, stats_interval=%d, screen=%d, screen_steps=%d\n",
+			params->population_size, params->states, params->symbols, params->best_cnt, params->kids_cnt, params->degeneration_cnt,
+			params->engine, loop_check, sweeps, rle_min_len, params->cache_size, params->checkpoint_interval, params->early_abort, params->pages, params->seed,
+			params->topology, params->migration_interval, params->migrants, params->work_stealing,
+			params->snapshot_interval, params->generations, params->stats_interval,
+			params->screen_pass, params->screen_steps);
 }
 
-tParams params={10000, 12, 4, 5000, 10, 1000, "output"};
+tParams params={10000, 12, 4, 5000, 10, 1000, "output", ENGINE_FAST, CACHE_DEFAULT_SIZE, 0, 1, PAGES_THP, 0, TOPOLOGY_NONE, 10, 5, 0, NULL, NULL, SNAPSHOT_DEFAULT_INTERVAL, 0, 0, STATS_DEFAULT_INTERVAL,
+		0, SCREEN_DEFAULT_STEPS};
 
 volatile int log_level=LOG_NONE_0;
 void sighandler(int sig)
@@ -126,6 +195,9 @@ void sighandler(int sig)
 			"best_cnt=%d, kids_cnt=%d, degeneration_cnt=%d\n",
 			old_log_level, params.population_size, params.states, params.symbols,
 			params.best_cnt, params.kids_cnt, params.degeneration_cnt);
+	if (fitness_cache) fitness_cache_print(fitness_cache, stdout);
+	if (islands) islands_print(islands, stdout);
+	if (cluster) cluster_print(cluster, stdout);
 	printf("Enter <0..3> as log_level | [b BEST_CNT] | [d DEGENERATION_CNT] [k KIDS_CNT], 'c' for continue, anything else for exit:\n");
 	if (fgets(line, 255, stdin)!=NULL) {
 		if (isdigit(line[0])) {
@@ -156,21 +228,68 @@ void sighandler(int sig)
 }
 
 int main(int argc, char **argv) {
-	char log[20000];
-	int cpus=omp_get_num_procs();
-	int n=sizeof(Sample_tapes)/sizeof(tTape);
+	int cpus=omp_get_max_threads();
+	int n=NR_OF_SAMPLE_TAPES, n_threads;
 	tTapeMetrics metrics[n];
 
 	signal(SIGINT, &sighandler);
+	signal(SIGUSR1, &stats_request);
 
+	params.seed=time(NULL);
 	get_options(argc, argv, &params);
+	if (params.resume) {
+		n_threads=snapshot_params(params.output, &params);
+		if (!params.work_stealing) cpus=n_threads;
+		printf("Resuming %d threads with the snapshot's parameters: population size=%d, states=%d, symbols=%d, "
+				"best_cnt=%d, kids_cnt=%d, engine=%d\n", n_threads, params.population_size, params.states,
+				params.symbols, params.best_cnt, params.kids_cnt, params.engine);
+	}
+	if (params.coordinator)
+		cluster_coordinator(params.coordinator, params.states*params.symbols);
+	if (params.worker && (cluster=cluster_connect(params.worker, params.states*params.symbols))==NULL) {
+		fprintf(stderr, "Can't connect to the coordinator at %s!\n", params.worker);
+		exit(-1);
+	}
+	set_turing_engine(params.engine, params.states, params.symbols);
+	set_kernels(params.states, params.symbols);
+	if (params.cache_size>0 && (fitness_cache=fitness_cache_init(params.cache_size))==NULL) {
+		fprintf(stderr, "Can't allocate memory for the fitness cache!\n");
+		exit(-1);
+	}
 	calc_all_tapes_metrics(Sample_tapes, metrics, n);
+	if (rle_min_len>0) set_rle_tapes(Sample_tapes, n, rle_min_len);
+	set_screening(&params, Sample_tapes, n);
 	printf("Using CPUs=%d\n", cpus);
+	if (params.topology!=TOPOLOGY_NONE) {
+		if (params.work_stealing)
+			printf("The single population makes no islands, evolving without migration\n");
+		else if (cpus<2)
+			printf("A single thread makes no islands, evolving without migration\n");
+		else if ((islands=islands_init(cpus, params.topology, params.states*params.symbols))==NULL) {
+			fprintf(stderr, "Can't allocate memory for the islands!\n");
+			exit(-1);
+		}
+	}
+	if (cpus>1 && (params.cache_size>0 || islands))
+		printf("The threads share the fitness cache or migrants, the run can't be repeated exactly\n");
+	if ((results=results_init(&params, params.work_stealing ? 1 : cpus))==NULL) {
+		fprintf(stderr, "Can't open the results log in %s!\n", params.output);
+		exit(-1);
+	}
+	if ((stats=stats_init(&params, cpus))==NULL) {
+		fprintf(stderr, "Can't open the stats file in %s!\n", params.output);
+		exit(-1);
+	}
+	print_memory_footprint(&params, n, params.work_stealing ? 1 : cpus);
 	//log_level=LOG_ALL_2;
-	eval_sorting_fitness_n_tapes(&demoBubble, Sample_tapes, n, log);
-	#pragma omp parallel num_threads(cpus)
-		evolve_turing(&params, Sample_tapes, n);
-
+	eval_sorting_fitness_n_tapes(&demoBubble, Sample_tapes, n);
+	if (params.work_stealing)
+		evolve_turing(&params, Sample_tapes, n);	// the threads are started for the evaluations
+	else
+		#pragma omp parallel num_threads(cpus)
+			evolve_turing(&params, Sample_tapes, n);
+	results_close(results);
+	stats_close(stats);
 	return 0;
 
 }
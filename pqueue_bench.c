@@ -0,0 +1,106 @@
+/**
+ * Microbenchmark of the population queues: the binary max-heap (pqueue.c)
+ * versus the double-ended treap (dpqueue.c), in the evolution's pattern -
+ * the worst individual is replaced by a kid of random fitness - plus the rank queries
+ * of the treap. For the heap, it also shows how bad its "worst" (the last leaf) really is.
+ *
+ * gcc -std=gnu99 -fgnu89-inline -O2 pqueue_bench.c pqueue.c dpqueue.c -o pqueue_bench
+ * ./pqueue_bench [OPERATIONS]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "pqueue.h"
+#include "dpqueue.h"
+
+#define SAMPLES 100		// replaced items, whose rank is measured
+
+static double now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+static double random_fitness(void) {
+	return (double)rand()/RAND_MAX;
+}
+
+// @return the fraction of the population worse than the fitness f
+static double percentile(tIndividual * population, int n, double f) {
+	int i, worse=0;
+	for (i=0; i<n; i++) worse+=population[i].fitness < f;
+	return (double)worse/n;
+}
+
+int main(int argc, char ** argv) {
+	int sizes[]={10000, 100000, 1000000}, k, n, i, j, samples, ops=argc>1 ? atoi(argv[1]) : 1000000;
+	tIndividual * population, * d;
+	pqueue_t * heap;
+	dpqueue_t * dpq;
+	double t0, t_heap_insert, t_heap_replace, t_dpq_insert, t_dpq_replace, t_dpq_rank, heap_worst, dpq_worst;
+	volatile double sink=0;
+
+	printf("population\theap insert\theap replace\ttreap insert\ttreap replace\ttreap rank\t"
+			"replaced worse than: heap\ttreap\t(ns per op)\n");
+	for (k=0; k<sizeof(sizes)/sizeof(*sizes); k++) {
+		n=sizes[k];
+		if ((population=malloc(n*sizeof(tIndividual)))==NULL ||
+				(heap=pqueue_init(n))==NULL || (dpq=dpqueue_init(n))==NULL) {
+			fprintf(stderr, "Can't allocate memory for the population of %d!\n", n);
+			exit(-1);
+		}
+		// the heap
+		srand(n);
+		for (i=0; i<n; i++) population[i].fitness=random_fitness();
+		t0=now();
+		for (i=0; i<n; i++) pqueue_insert(heap, population+i);
+		t_heap_insert=now()-t0;
+		heap_worst=samples=0;
+		t0=now();
+		for (i=0; i<ops; i++) {
+			d=pqueue_get(heap, n);
+			if (i%(ops/SAMPLES+1)==0) {
+				t_heap_replace=now()-t0;
+				heap_worst+=percentile(population, n, d->fitness);
+				samples++;
+				t0=now()-t_heap_replace;
+			}
+			d->fitness=random_fitness();
+			pqueue_priority_changed(heap, 1.0, n);	// the parent's fitness, as in evolve_turing()
+		}
+		t_heap_replace=now()-t0;
+		// the treap, the same population
+		srand(n);
+		for (i=0; i<n; i++) population[i].fitness=random_fitness();
+		t0=now();
+		for (i=0; i<n; i++) dpqueue_insert(dpq, i, population[i].fitness);
+		t_dpq_insert=now()-t0;
+		dpq_worst=0;
+		t0=now();
+		for (i=0; i<ops; i++) {
+			j=dpqueue_get(dpq, n);
+			if (i%(ops/SAMPLES+1)==0) {
+				t_dpq_replace=now()-t0;
+				dpq_worst+=percentile(population, n, population[j].fitness);
+				t0=now()-t_dpq_replace;
+			}
+			population[j].fitness=random_fitness();
+			dpqueue_priority_changed(dpq, n, population[j].fitness);
+		}
+		t_dpq_replace=now()-t0;
+		t0=now();
+		for (i=0; i<ops; i++) sink+=population[dpqueue_get(dpq, 1+rand()%n)].fitness;
+		t_dpq_rank=now()-t0;
+		if (!dpqueue_is_valid(dpq)) {
+			fprintf(stderr, "The treap is broken!\n");
+			exit(-1);
+		}
+		printf("%d\t%.1lf\t%.1lf\t%.1lf\t%.1lf\t%.1lf\t%.4lf\t%.4lf\n", n,
+				1e9*t_heap_insert/n, 1e9*t_heap_replace/ops, 1e9*t_dpq_insert/n, 1e9*t_dpq_replace/ops,
+				1e9*t_dpq_rank/ops, heap_worst/samples, dpq_worst/samples);
+		pqueue_free(heap);
+		dpqueue_free(dpq);
+		free(population);
+	}
+	return 0;
+}
@@ -0,0 +1,74 @@
+#include "prng.h"
+
+ulong Prng_state[4];
+#pragma omp threadprivate(Prng_state)
+
+static inline ulong rotl(ulong x, int k) {
+	return (x << k) | (x >> (64-k));
+}
+
+static ulong splitmix64(ulong * x) {
+	ulong z=(*x+=0x9e3779b97f4a7c15UL);
+	z=(z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+	z=(z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+	return z ^ (z >> 31);
+}
+
+ulong prng_next(void) {
+	ulong * s=Prng_state, result=rotl(s[1]*5, 7)*9, t=s[1] << 17;
+
+	s[2]^=s[0];
+	s[3]^=s[1];
+	s[1]^=s[2];
+	s[0]^=s[3];
+	s[2]^=t;
+	s[3]=rotl(s[3], 45);
+	return result;
+}
+
+// advances the state by 2^128 numbers
+static void jump(void) {
+	static const ulong jump[]={0x180ec6d33cfd0abaUL, 0xd5a61266f0c9392cUL, 0xa9582618e03fc9aaUL, 0x39abdc4529b1661cUL};
+	ulong s[4]={0, 0, 0, 0};
+	int i, j, b;
+
+	for (i=0; i<4; i++)
+		for (b=0; b<64; b++) {
+			if (jump[i] & (1UL << b))
+				for (j=0; j<4; j++) s[j]^=Prng_state[j];
+			prng_next();
+		}
+	for (j=0; j<4; j++) Prng_state[j]=s[j];
+}
+
+void prng_seed(ulong seed, int stream) {
+	int i;
+
+	for (i=0; i<4; i++) Prng_state[i]=splitmix64(&seed);
+	while (stream--) jump();
+}
+
+void prng_save(ulong * state) {
+	int i;
+	for (i=0; i<4; i++) state[i]=Prng_state[i];
+}
+
+void prng_restore(ulong * state) {
+	int i;
+	for (i=0; i<4; i++) Prng_state[i]=state[i];
+}
+
+// Lemire's multiply and reject: the high half of a 32x32 bit product
+inline unsigned prng_below(unsigned n) {
+	ulong m=(prng_next() >> 32)*n;
+	unsigned low=m, threshold;
+
+	if (low < n) {
+		threshold=-n % n;
+		while (low < threshold) {
+			m=(prng_next() >> 32)*n;
+			low=m;
+		}
+	}
+	return m >> 32;
+}
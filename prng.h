@@ -0,0 +1,26 @@
+#ifndef PRNG_H
+#define PRNG_H
+
+#include "turing.h"
+
+/**
+ * xoshiro256** generator of each thread, seeded by splitmix64.
+ * The threads get non-overlapping streams of the same seed, so a seed
+ * and a nr. of threads determine all the random numbers of a run.
+ */
+
+/**
+ * Seeds the current thread's generator.
+ * @param stream the stream of the seed, 2^128 numbers apart (the thread nr.)
+ */
+void prng_seed(ulong seed, int stream);
+ulong prng_next(void);
+// copies the current thread's generator state out of (save) or into (restore) state[4]
+void prng_save(ulong * state);
+void prng_restore(ulong * state);
+/**
+ * @return uniformly distributed number in <0, n), without the modulo bias
+ */
+inline unsigned prng_below(unsigned n);
+
+#endif
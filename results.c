@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "results.h"
+#include "common.h"
+
+tResults * results=NULL;
+
+#define record(r, thread, i)	((tResultRecord *)((r)->records+((size_t)(thread)*(RESULTS_QUEUE+1)+(i))*(r)->record_size))
+
+static double elapsed(tResults * r) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec-r->start.tv_sec + (t.tv_nsec-r->start.tv_nsec)*1e-9;
+}
+
+static void write_record(tResults * r, int thread, tResultRecord * rec) {
+	int j;
+
+	fprintf(r->f, "{\"fitness\":%.9lf,\"thread\":%d,\"generation\":%lu,\"restarts\":%lu,\"time\":%.3lf,\"table\":[",
+			rec->fitness, thread, rec->generation, rec->restarts, rec->time);
+	for (j=0; j<r->states*r->symbols; j++)
+		fprintf(r->f, "%s[%d,%d,%d]", j ? "," : "", TRANS_STATE(rec->table[j]), TRANS_SYMBOL(rec->table[j]),
+				TRANS_SHIFT(rec->table[j]));
+	fprintf(r->f, "]}\n");
+	if (log_level>=LOG_BEST_1)
+		printf("Fitness=%.6lf, thread_id=%d, generation=%lu, restarts=%lu\n",
+				rec->fitness, thread, rec->generation, rec->restarts);
+}
+
+// writes the queued records, @return 1 if there was any
+static int write_records(tResults * r) {
+	tResultQueue * q;
+	ulong head, tail;
+	int i, written=0;
+
+	for (i=0; i<r->threads; i++) {
+		q=r->queues+i;
+		head=__atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+		for (tail=q->tail; tail!=head; tail++, written=1)
+			write_record(r, i, record(r, i, tail%RESULTS_QUEUE));
+		__atomic_store_n(&q->tail, tail, __ATOMIC_RELEASE);
+	}
+	return written;
+}
+
+static void * writer_thread(void * arg) {
+	tResults * r=arg;
+
+	while (!r->stop) {
+		usleep(RESULTS_FLUSH_MS*1000);
+		if (write_records(r)) fflush(r->f);
+	}
+	return NULL;
+}
+
+tResults * results_init(tParams * params, int threads) {
+	tResults * r;
+	char path[4096];
+	time_t now=time(NULL);
+
+	snprintf(path, sizeof(path), "%s/%s", params->output, RESULTS_FILE);
+	if ((r=calloc(1, sizeof(tResults)))==NULL || (r->f=fopen(path, "a"))==NULL)
+		return NULL;
+	r->threads=threads;
+	r->states=params->states;
+	r->symbols=params->symbols;
+	r->record_size=(sizeof(tResultRecord)+params->states*params->symbols*sizeof(tTransTableItem)+7) & ~7UL;
+	if (posix_memalign((void **)&r->queues, 64, threads*sizeof(tResultQueue)) ||
+			(r->records=malloc(threads*(RESULTS_QUEUE+1)*r->record_size))==NULL) {
+		fprintf(stderr, "Can't allocate memory for the results!\n");
+		exit(-1);
+	}
+	memset(r->queues, 0, threads*sizeof(tResultQueue));
+	clock_gettime(CLOCK_MONOTONIC, &r->start);
+	fprintf(r->f, "{\"run\":{\"started\":%ld,\"population_size\":%d,\"states\":%d,\"symbols\":%d,\"best_cnt\":%d,"
+			"\"kids_cnt\":%d,\"degeneration_cnt\":%d,\"engine\":%d,\"loop_check\":%d,\"seed\":%lu,\"threads\":%d}}\n",
+			(long)now, params->population_size, params->states, params->symbols, params->best_cnt,
+			params->kids_cnt, params->degeneration_cnt, params->engine, loop_check, params->seed, threads);
+	fflush(r->f);
+	if (pthread_create(&r->writer, NULL, writer_thread, r)) {
+		fprintf(stderr, "Can't start the results writer!\n");
+		exit(-1);
+	}
+	return r;
+}
+
+void results_best(tResults * r, int thread_id, tTransTableItem * table, double fitness,
+		ulong generation, ulong restarts) {
+	tResultRecord * rec;
+
+	if (r==NULL) return;
+	rec=record(r, thread_id, RESULTS_QUEUE);
+	rec->fitness=fitness;
+	rec->time=elapsed(r);
+	rec->generation=generation;
+	rec->restarts=restarts;
+	memcpy(rec->table, table, r->states*r->symbols*sizeof(tTransTableItem));
+	r->queues[thread_id].pending=1;
+}
+
+void results_generation(tResults * r, int thread_id) {
+	tResultQueue * q;
+
+	if (r==NULL || !r->queues[thread_id].pending) return;
+	q=r->queues+thread_id;
+	while (q->head-__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) >= RESULTS_QUEUE)
+		usleep(1000);		// the writer is behind
+	memcpy(record(r, thread_id, q->head%RESULTS_QUEUE), record(r, thread_id, RESULTS_QUEUE), r->record_size);
+	q->pending=0;
+	__atomic_store_n(&q->head, q->head+1, __ATOMIC_RELEASE);
+}
+
+void results_close(tResults * r) {
+	int i;
+
+	r->stop=1;
+	pthread_join(r->writer, NULL);
+	write_records(r);
+	for (i=0; i<r->threads; i++)
+		if (r->queues[i].pending) write_record(r, i, record(r, i, RESULTS_QUEUE));
+	fclose(r->f);
+}
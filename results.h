@@ -0,0 +1,68 @@
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <pthread.h>
+#include <time.h>
+#include "evolve_turing.h"
+
+#define RESULTS_FILE "results.jsonl"
+#define RESULTS_FLUSH_MS 100	// the writer's period
+#define RESULTS_QUEUE 64		// the generations' records of a thread, which the writer hasn't written yet
+
+// a new best individual, the last one of its generation
+typedef struct {
+	double fitness, time;	// seconds since the start
+	ulong generation, restarts;
+	tTransTableItem table[];
+} tResultRecord;
+
+/**
+ * The records of a thread: it keeps the newest best of the current generation in the pending
+ * record and queues it at the end of the generation, so the log doesn't depend on the timing
+ * of the writer. Only the thread moves head, only the writer moves tail; the thread waits
+ * for the writer, when the queue is full.
+ */
+typedef struct {
+	ulong head;
+	int pending;			// the pending record holds a best of the current generation
+	ulong tail __attribute__((aligned(64)));
+} __attribute__((aligned(64))) tResultQueue;
+
+/**
+ * The results log of a run, OUTPUT/results.jsonl: a "run" line with the parameters,
+ * then a line for each generation which found a new best individual (the last one found),
+ * written by a background writer thread. export_gv renders them as the .gv graphs.
+ */
+typedef struct {
+	FILE * f;
+	int threads, states, symbols;
+	size_t record_size;		// aligned
+	tResultQueue * queues;	// [threads]
+	char * records;			// [threads][RESULTS_QUEUE+1], the last one of a thread is its pending record
+	struct timespec start;
+	pthread_t writer;
+	volatile int stop;		// see results_close()
+} tResults;
+
+extern tResults * results;	// NULL = the new bests aren't logged
+
+/**
+ * Opens the results log in append mode, writes the run line and starts the writer.
+ * @return NULL if the log can't be opened
+ */
+tResults * results_init(tParams * params, int threads);
+/**
+ * Keeps the thread's new best individual as the record of the current generation.
+ */
+void results_best(tResults * r, int thread_id, tTransTableItem * table, double fitness,
+		ulong generation, ulong restarts);
+/**
+ * The thread ends its generation: its record, if any, goes to the writer.
+ */
+void results_generation(tResults * r, int thread_id);
+/**
+ * Stops the writer, writes the records it hasn't written yet (the pending ones, too) and closes the log.
+ */
+void results_close(tResults * r);
+
+#endif
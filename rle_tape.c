@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rle_tape.h"
+#include "common.h"
+
+// the flat copy of a tape for the loop detection, both reused by the next runs
+static schar * Flat;
+static int Flat_capacity;
+static tLoopCheck Loop;
+#pragma omp threadprivate(Flat, Flat_capacity, Loop)
+
+// @return a block of the pool, out of the list
+static int block_alloc(tRleTape * tape) {
+	int i;
+
+	if (tape->free < 0) {
+		i=tape->capacity;
+		tape->capacity=tape->capacity ? 2*tape->capacity : 64;
+		if ((tape->blocks=realloc(tape->blocks, tape->capacity*sizeof(tRleBlock)))==NULL) {
+			fprintf(stderr, "Can't allocate memory for the tape!\n");
+			exit(-1);
+		}
+		for (; i<tape->capacity; i++) {
+			tape->blocks[i].next=tape->free;
+			tape->free=i;
+		}
+	}
+	i=tape->free;
+	tape->free=tape->blocks[i].next;
+	return i;
+}
+
+// inserts a new block after the block "after" (-1 = at the start) into the list
+static int block_insert(tRleTape * tape, int after, schar symbol, int len) {
+	int i=block_alloc(tape), next=after<0 ? tape->first : tape->blocks[after].next;
+	tRleBlock * b=tape->blocks+i;
+
+	b->symbol=symbol;
+	b->len=len;
+	b->prev=after;
+	b->next=next;
+	if (after<0) tape->first=i;
+	else tape->blocks[after].next=i;
+	if (next>=0) tape->blocks[next].prev=i;
+	tape->count++;
+	return i;
+}
+
+static void block_remove(tRleTape * tape, int i) {
+	tRleBlock * b=tape->blocks+i;
+
+	if (b->prev<0) tape->first=b->next;
+	else tape->blocks[b->prev].next=b->next;
+	if (b->next>=0) tape->blocks[b->next].prev=b->prev;
+	b->next=tape->free;
+	tape->free=i;
+	tape->count--;
+}
+
+// empties the list, its blocks stay in the pool
+static void rle_clear(tRleTape * tape) {
+	while (tape->first>=0) block_remove(tape, tape->first);
+}
+
+void rle_encode(tRleTape * tape, schar * cells, int input_len) {
+	int i, last=-1;
+
+	if (tape->capacity==0) tape->free=tape->first=-1;
+	rle_clear(tape);
+	tape->input_len=input_len;
+	tape->limit=TAPE_LIMIT(input_len);
+	for (i=0; i<tape->limit; i++) {
+		schar symbol=i<input_len ? cells[i] : BLANK;
+		if (last>=0 && tape->blocks[last].symbol==symbol) {
+			if (i>=input_len) {		// the BLANKs up to the limit
+				tape->blocks[last].len+=tape->limit-i;
+				break;
+			}
+			tape->blocks[last].len++;
+		} else last=block_insert(tape, last, symbol, 1);
+	}
+}
+
+void rle_copy(tRleTape * from, tRleTape * to) {
+	int i, last=-1;
+
+	if (to->capacity==0) to->free=to->first=-1;
+	rle_clear(to);
+	to->input_len=from->input_len;
+	to->limit=from->limit;
+	for (i=from->first; i>=0; i=from->blocks[i].next)
+		last=block_insert(to, last, from->blocks[i].symbol, from->blocks[i].len);
+}
+
+void rle_decode(tRleTape * tape, schar * cells, int n) {
+	int i, len, pos=0;
+
+	for (i=tape->first; i>=0 && pos<n; i=tape->blocks[i].next, pos+=len) {
+		len=tape->blocks[i].len < n-pos ? tape->blocks[i].len : n-pos;
+		memset(cells+pos, tape->blocks[i].symbol, len);
+	}
+}
+
+void rle_free(tRleTape * tape) {
+	free(tape->blocks);
+	memset(tape, 0, sizeof(tRleTape));
+}
+
+/**
+ * Moves the cursor by d cells.
+ * @return 0 if the head leaves the tape, the cursor is invalid then
+ */
+static inline int rle_move(tRleTape * tape, tRleCursor * c, int d) {
+	c->offset+=d;
+	while (c->offset >= tape->blocks[c->block].len) {
+		c->offset-=tape->blocks[c->block].len;
+		if ((c->block=tape->blocks[c->block].next) < 0) return 0;
+	}
+	while (c->offset < 0) {
+		if ((c->block=tape->blocks[c->block].prev) < 0) return 0;
+		c->offset+=tape->blocks[c->block].len;
+	}
+	return 1;
+}
+
+// writes another symbol under the cursor: splits its block, or merges it with the neighbours
+static void rle_write(tRleTape * tape, tRleCursor * c, schar symbol) {
+	tRleBlock * blocks=tape->blocks;
+	int i=c->block, prev=blocks[i].prev, next=blocks[i].next, len=blocks[i].len;
+
+	if (len==1) {
+		blocks[i].symbol=symbol;
+		if (prev>=0 && blocks[prev].symbol==symbol) {
+			blocks[prev].len++;
+			block_remove(tape, i);
+			i=prev;
+		}
+		if (next>=0 && blocks[next].symbol==symbol) {
+			c->offset=blocks[i].len-1;
+			blocks[i].len+=blocks[next].len;
+			block_remove(tape, next);
+		} else c->offset=blocks[i].len-1;
+		c->block=i;
+	} else if (c->offset==0) {
+		blocks[i].len--;
+		if (prev>=0 && blocks[prev].symbol==symbol) {
+			c->block=prev;
+			c->offset=blocks[prev].len++;
+		} else c->block=block_insert(tape, prev, symbol, 1);
+	} else if (c->offset==len-1) {
+		blocks[i].len--;
+		if (next>=0 && blocks[next].symbol==symbol) blocks[next].len++;
+		else next=block_insert(tape, i, symbol, 1);
+		c->block=next;
+		c->offset=0;
+	} else {		// the rest of the block goes after the new one
+		block_insert(tape, i, blocks[i].symbol, len-c->offset-1);
+		c->block=block_insert(tape, i, symbol, 1);
+		tape->blocks[i].len=c->offset;
+		c->offset=0;
+	}
+}
+
+// decodes the first n cells for the loop detection, up to the BLANKs at the end
+static int rle_flat(tRleTape * tape, int n) {
+	int size=0, i;
+
+	for (i=tape->first; i>=0 && size<n; i=tape->blocks[i].next)
+		if (tape->blocks[i].next>=0 || tape->blocks[i].symbol!=BLANK) size+=tape->blocks[i].len;
+	if (size > n) size=n;
+	if (size > Flat_capacity) {
+		if ((Flat=realloc(Flat, size))==NULL) {
+			fprintf(stderr, "Can't allocate memory for the loop detection!\n");
+			exit(-1);
+		}
+		Flat_capacity=size;
+	}
+	rle_decode(tape, Flat, size);
+	return size;
+}
+
+void turing_rle(tRleTape * tape, tTransitions * t, int max_steps, tStatus * status) {
+	tLoopCheck * loop=&Loop;
+	tRleCursor c={tape->first, status->head};
+	tRleBlock * b;
+	tTransTableItem item;
+	int head=status->head, steps=status->steps, writes=status->writes, state=status->state,
+		symbol, n, period, looped=0, size;
+	ulong hash=0;
+
+	if (head<0 || head>=tape->limit || !rle_move(tape, &c, 0)) {
+		status->error=ERR_BOUNDS;
+		return;
+	}
+	loop_check_init(loop, steps, head, tape->limit);
+	while (steps < max_steps && state < t->states) {
+		if (steps==loop->next) {
+			size=rle_flat(tape, loop_check_len(loop, steps));
+			loop_check_save(loop, Flat, size, steps, writes, state, head, hash);
+		} else if (state==loop->state && head==loop->head && steps!=loop->steps && hash==loop->hash) {
+			size=rle_flat(tape, loop->len);
+			if ((period=loop_check_period(loop, Flat, size, steps, hash))) {
+				loop_check_skip(loop, period, max_steps, &steps, &writes);
+				looped=1;
+				continue;
+			}
+		}
+		b=tape->blocks+c.block;
+		item=t->table[state*t->symbols+b->symbol];
+		if (t->used) USED_SET(t->used, state*t->symbols+b->symbol);
+		symbol=TRANS_SYMBOL(item);
+		if (sweeps && TRANS_STATE(item)==state && (symbol<0 || symbol==b->symbol) &&
+				(TRANS_SHIFT(item)==R || TRANS_SHIFT(item)==L)) {
+			// the rest of the block, up to the step limit and the next loop check
+			n=TRANS_SHIFT(item)==R ? b->len-c.offset : c.offset+1;
+			if (max_steps-steps < n) n=max_steps-steps;
+			if (loop->next-steps < n) n=loop->next-steps;
+			if (state==loop->state && (TRANS_SHIFT(item)==R ? loop->head>head : loop->head<head) &&
+					abs(loop->head-head) < n)
+				n=abs(loop->head-head);
+			steps+=n;
+			if (symbol>=0) {
+				writes+=n;
+				if (TRANS_SHIFT(item)==R && head+n-1 > status->head_max) status->head_max=head+n-1;
+				if (TRANS_SHIFT(item)==L && head > status->head_max) status->head_max=head;
+			}
+			if (TRANS_SHIFT(item)==L) n=-n;
+		} else {
+			steps++;
+			state=TRANS_STATE(item);
+			if (symbol>=0) {
+				hash+=LOOP_HASH(b->symbol, symbol, head);
+				if (symbol!=b->symbol) rle_write(tape, &c, symbol);
+				writes++;
+				if (head>status->head_max) status->head_max=head;
+			}
+			switch (TRANS_SHIFT(item)) {
+				case R: n=1; break;
+				case L: n=-1; break;
+				case RR: n=2; break;
+				default: n=0;
+			}
+		}
+		head+=n;
+		if (head<0 || head>=tape->limit || !rle_move(tape, &c, n)) {
+			if (log_level>=LOG_DEBUG_3) fprintf(stderr, "Head out of bounds!\n");
+			status->error=ERR_BOUNDS;
+			break;
+		}
+	}
+	status->head=head;
+	status->steps=steps;
+	status->writes=writes;
+	status->state=state;
+	if (looped && status->error!=ERR_BOUNDS) status->error=ERR_LOOP;
+}
@@ -0,0 +1,47 @@
+#ifndef RLE_TAPE_H
+#define RLE_TAPE_H
+
+#include "turing.h"
+
+/**
+ * A tape as runs of a symbol: a doubly linked list of blocks in a pool, which covers
+ * all the cells up to the limit (the last block holds the BLANKs after the input).
+ * A write splits the block under the head and merges it with the equal neighbours,
+ * so the blocks stay maximal runs and the memory follows the number of runs, not cells.
+ */
+typedef struct {
+	int len;			// cells
+	int prev, next;		// in the list, -1 at its ends
+	schar symbol;
+} tRleBlock;
+
+typedef struct {
+	tRleBlock * blocks;	// the pool
+	int capacity;
+	int free;			// the free blocks, linked by next
+	int first, count;	// the list
+	int input_len, limit;
+} tRleTape;
+
+// the head: its block and the offset in it
+typedef struct {
+	int block, offset;
+} tRleCursor;
+
+// encodes the input cells of a flat tape, the cells from input_len on are BLANK
+void rle_encode(tRleTape * tape, schar * cells, int input_len);
+// from gets copied into to, whose pool is reused
+void rle_copy(tRleTape * from, tRleTape * to);
+// decodes the first n cells
+void rle_decode(tRleTape * tape, schar * cells, int n);
+void rle_free(tRleTape * tape);
+
+/**
+ * The reference engine on a run-length encoded tape: the same status, the same
+ * tape and the same used items as turing() on the decoded tape. The sweeps (see turing.h)
+ * move over the rest of the head's block at once, whatever its length.
+ * The loop detection decodes the tape, when it saves or compares the configuration.
+ */
+void turing_rle(tRleTape * tape, tTransitions * t, int max_steps, tStatus * status);
+
+#endif
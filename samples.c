@@ -0,0 +1,44 @@
+#include "samples.h"
+
+typedef enum {
+	start, was_1, was_2, was_3,  s2_1,  s3_1,  s3_2, was_2_swap, was_3_swap, search_blank, error, end
+} tDemoBubbleStates;
+
+tTransTableItem demoBubbleTable[]={
+	// 0=start:	BLANK		1			2				3
+	  TRANS_ITEM(end, E, N), TRANS_ITEM(was_1, E, R), TRANS_ITEM(was_2, E, R), TRANS_ITEM(was_3, E, R) ,
+	// 1=was_1:	BLANK		1			2				3
+	  TRANS_ITEM(end, E, N), TRANS_ITEM(was_1, E, R), TRANS_ITEM(was_2, E, R), TRANS_ITEM(was_3, E, R) ,
+	// 2=was_2:	BLANK		1			2				3
+	  TRANS_ITEM(end, E, N), TRANS_ITEM(s2_1, 2, L), TRANS_ITEM(was_2, E, R), TRANS_ITEM(was_3, E, R) ,
+	// 3=was_3:	BLANK		1			2				3
+	  TRANS_ITEM(end, E, N), TRANS_ITEM(s3_1, 3, L), TRANS_ITEM(s3_2, 3, L), TRANS_ITEM(was_3, E, R) ,
+	// 4=s2_1:	BLANK		1			2				3
+	  TRANS_ITEM(error, E, N), TRANS_ITEM(error, E, N), TRANS_ITEM(was_2_swap, 1, RR) , TRANS_ITEM(error, E, N),
+	// 5=s3_1:	BLANK		1			2				3
+	  TRANS_ITEM(error, E, N), TRANS_ITEM(error, E, N), TRANS_ITEM(error, E, N), TRANS_ITEM(was_3_swap, 1, RR) ,
+	// 6=s3_2:	BLANK		1			2				3
+	  TRANS_ITEM(error, E, N), TRANS_ITEM(error, E, N), TRANS_ITEM(error, E, N), TRANS_ITEM(was_3_swap, 2, RR) ,
+	// 7=was_2_swap:BLANK		1			2				3
+	  TRANS_ITEM(search_blank, E, L), TRANS_ITEM(s2_1, 2, L), TRANS_ITEM(was_2_swap, E, R),  TRANS_ITEM(was_3_swap, E, R) ,
+	// 8=was_3_swap:BLANK		1			2				3
+	  TRANS_ITEM(search_blank, E, L), TRANS_ITEM(s3_1, 3, L), TRANS_ITEM(s3_2, 3, L),  TRANS_ITEM(was_3_swap, E, R) ,
+	// 9=search_blank:	BLANK		1			2				3
+	  TRANS_ITEM(start, E, R), TRANS_ITEM(search_blank, E, L), TRANS_ITEM(search_blank, E, L), TRANS_ITEM(search_blank, E, L) 
+	// 10=error (final state)
+	// 11=end (final state)
+};
+
+#define DEMOBUBBLE_SYMBOLS 4
+tTransitions demoBubble = {	
+		sizeof(demoBubbleTable)/sizeof(tTransTableItem)/DEMOBUBBLE_SYMBOLS,
+		//=10,									// nr. of states
+	DEMOBUBBLE_SYMBOLS,					// nr. of symbols
+	demoBubbleTable 					// transition table
+};
+
+tTape Sample_tapes[NR_OF_SAMPLE_TAPES] = {
+		{(schar[])SAMPLE_TAPE1, sizeof((schar[])SAMPLE_TAPE1)},
+		{(schar[])SAMPLE_TAPE2, sizeof((schar[])SAMPLE_TAPE2)},
+		{(schar[])SAMPLE_TAPE3, sizeof((schar[])SAMPLE_TAPE3)},
+};
@@ -0,0 +1,14 @@
+#ifndef SAMPLES_H
+#define SAMPLES_H
+
+#include "turing.h"
+#include "evolve_turing.h"
+
+/**
+ * The workload shared by the evolution, bench and export_gv: the sample tapes
+ * and demoBubble, a hand-written bubble sort of their symbols.
+ */
+extern tTape Sample_tapes[NR_OF_SAMPLE_TAPES];
+extern tTransitions demoBubble;
+
+#endif
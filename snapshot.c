@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+#include "prng.h"
+
+// the offsets of the arrays in h and @return the file size
+static size_t layout(tSnapshotHeader * h, tParams * params) {
+	size_t n=params->population_size, table_size=params->states*params->symbols;
+
+	h->tables=arena_size(sizeof(tSnapshotHeader));
+	h->fitness=h->tables+arena_size(n*table_size*sizeof(tTransTableItem));
+	h->used=h->fitness+arena_size(n*sizeof(double));
+	h->nodes=h->used+arena_size(n*USED_WORDS(table_size)*sizeof(ulong));
+	return h->size=h->nodes+arena_size((n+1)*sizeof(tDpqNode));
+}
+
+size_t snapshot_size(tParams * params) {
+	tSnapshotHeader h;
+	return layout(&h, params);
+}
+
+static void snapshot_path(char * path, char * output, int thread_id) {
+	snprintf(path, PATH_MAX, "%s/state-%d.bin", output, thread_id);
+}
+
+static int write_all(int fd, char * buf, size_t len) {
+	ssize_t written;
+
+	while (len > 0) {
+		if ((written=write(fd, buf, len)) < 0) return -1;
+		buf+=written;
+		len-=written;
+	}
+	return 0;
+}
+
+static void * write_snapshot(void * arg) {
+	tSnapshot * s=arg;
+	char tmp[PATH_MAX+4], dir[PATH_MAX];
+	int fd, ok;
+
+	sprintf(tmp, "%s.tmp", s->path);
+	fd=open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	ok=fd >= 0 && write_all(fd, s->buf, s->size)==0 && fsync(fd)==0;
+	if (fd >= 0) close(fd);
+	if (ok && rename(tmp, s->path)==0) {
+		// the rename itself must survive a crash, too
+		strcpy(dir, s->path);
+		if ((fd=open(dirname(dir), O_RDONLY))>=0) {
+			fsync(fd);
+			close(fd);
+		}
+	} else fprintf(stderr, "Can't write the snapshot %s!\n", s->path);
+	__atomic_store_n(&s->busy, 0, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+// copies the thread's state into s->buf, which the writer doesn't own
+static void snapshot_copy(tSnapshot * s, tParams * params, int thread_id, int threads, tPopulation * population,
+		dpqueue_t * queue, ulong generation, ulong last_success_generation, ulong restarts) {
+	tSnapshotHeader * h;
+
+	if (s->buf==NULL) {
+		s->size=snapshot_size(params);
+		if ((s->buf=calloc(1, s->size))==NULL) {
+			fprintf(stderr, "Can't allocate memory for the snapshot!\n");
+			exit(-1);
+		}
+		snapshot_path(s->path, params->output, thread_id);
+	}
+	h=(tSnapshotHeader *)s->buf;
+	memset(h, 0, sizeof(tSnapshotHeader));
+	strcpy(h->magic, SNAPSHOT_MAGIC);
+	h->version=SNAPSHOT_VERSION;
+	h->thread_id=thread_id;
+	h->threads=threads;
+	h->params=*params;
+	h->params.output=h->params.coordinator=h->params.worker=NULL;
+	h->generation=generation;
+	h->last_success_generation=last_success_generation;
+	h->restarts=restarts;
+	prng_save(h->prng);
+	h->queue=*queue;
+	h->queue.nodes=NULL;
+	layout(h, params);
+	memcpy(s->buf+h->tables, population->tables,
+			(size_t)population->size*population->table_size*sizeof(tTransTableItem));
+	memcpy(s->buf+h->fitness, population->fitness, population->size*sizeof(double));
+	memcpy(s->buf+h->used, population->used, (size_t)population->size*population->used_words*sizeof(ulong));
+	memcpy(s->buf+h->nodes, queue->nodes, queue->avail*sizeof(tDpqNode));
+}
+
+void snapshot_take(tSnapshot * s, tParams * params, int thread_id, int threads, tPopulation * population,
+		dpqueue_t * queue, ulong generation, ulong last_success_generation, ulong restarts) {
+	pthread_t writer;
+	pthread_attr_t attr;
+
+	if (__atomic_load_n(&s->busy, __ATOMIC_ACQUIRE)) return;
+	snapshot_copy(s, params, thread_id, threads, population, queue, generation, last_success_generation, restarts);
+	s->busy=1;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&writer, &attr, write_snapshot, s)) {
+		fprintf(stderr, "Can't start the snapshot writer!\n");
+		s->busy=0;
+	}
+	pthread_attr_destroy(&attr);
+}
+
+void snapshot_finish(tSnapshot * s, tParams * params, int thread_id, int threads, tPopulation * population,
+		dpqueue_t * queue, ulong generation, ulong last_success_generation, ulong restarts) {
+	while (__atomic_load_n(&s->busy, __ATOMIC_ACQUIRE)) usleep(SNAPSHOT_WAIT_MS*1000);
+	snapshot_copy(s, params, thread_id, threads, population, queue, generation, last_success_generation, restarts);
+	s->busy=1;
+	write_snapshot(s);
+	free(s->buf);
+	s->buf=NULL;
+}
+
+// @return the mapped snapshot, checked against the parameters
+static tSnapshotHeader * map_snapshot(char * output, int thread_id) {
+	char path[PATH_MAX];
+	struct stat st;
+	tSnapshotHeader * h;
+	int fd;
+
+	snapshot_path(path, output, thread_id);
+	if ((fd=open(path, O_RDONLY)) < 0 || fstat(fd, &st) || st.st_size < sizeof(tSnapshotHeader) ||
+			(h=mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0))==MAP_FAILED) {
+		fprintf(stderr, "Can't read the snapshot %s!\n", path);
+		exit(-1);
+	}
+	close(fd);
+	if (strcmp(h->magic, SNAPSHOT_MAGIC) || h->version!=SNAPSHOT_VERSION || h->thread_id!=thread_id ||
+			h->size!=st.st_size || snapshot_size(&h->params)!=st.st_size) {
+		fprintf(stderr, "%s is not a snapshot of thread %d of this version!\n", path, thread_id);
+		exit(-1);
+	}
+	return h;
+}
+
+void snapshot_load(tParams * params, int thread_id, tPopulation * population, dpqueue_t * queue,
+		ulong * generation, ulong * last_success_generation, ulong * restarts) {
+	tSnapshotHeader * h=map_snapshot(params->output, thread_id);
+	char * base=(char *)h;
+
+	if (h->params.population_size!=params->population_size || h->params.states!=params->states ||
+			h->params.symbols!=params->symbols) {
+		fprintf(stderr, "The snapshot of thread %d has other population parameters!\n", thread_id);
+		exit(-1);
+	}
+	population->size=params->population_size;
+	population->table_size=params->states*params->symbols;
+	population->used_words=USED_WORDS(population->table_size);
+	population->tables=(tTransTableItem *)(base+h->tables);
+	population->fitness=(double *)(base+h->fitness);
+	population->used=(ulong *)(base+h->used);
+	dpqueue_attach(queue, &h->queue, (tDpqNode *)(base+h->nodes));
+	prng_restore(h->prng);
+	*generation=h->generation;
+	*last_success_generation=h->last_success_generation;
+	*restarts=h->restarts;
+}
+
+int snapshot_params(char * output, tParams * params) {
+	tSnapshotHeader * h=map_snapshot(output, 0);
+	tParams saved=h->params;
+	int threads=h->threads;
+
+	saved.output=params->output;
+	saved.coordinator=params->coordinator;
+	saved.worker=params->worker;
+	saved.generations=params->generations;
+	saved.stats_interval=params->stats_interval;
+	saved.resume=1;
+	*params=saved;
+	munmap(h, h->size);
+	return threads;
+}
@@ -0,0 +1,65 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <limits.h>
+#include "evolve_turing.h"
+#include "dpqueue.h"
+
+#define SNAPSHOT_MAGIC "ETSNAP"
+#define SNAPSHOT_VERSION 5
+#define SNAPSHOT_DEFAULT_INTERVAL 60	// seconds
+#define SNAPSHOT_WAIT_MS 10		// the period of checking, if the writer is done
+
+/**
+ * The evolution state of a thread in <output>/state-<thread>.bin: this header,
+ * then the population arrays and the queue nodes, each at its offset, as they are in memory.
+ * A resumed thread maps the file and evolves the population right there (copy on write),
+ * so the restart doesn't read the population.
+ */
+typedef struct {
+	char magic[8];
+	unsigned version;
+	int thread_id, threads;
+	tParams params;			// without the strings
+	ulong generation, last_success_generation, restarts;
+	ulong prng[4];
+	dpqueue_t queue;		// without the nodes
+	size_t tables, fitness, used, nodes, size;	// offsets of the arrays, file size
+} tSnapshotHeader;
+
+/**
+ * The second copy of a thread's state, written by a writer thread while the evolution goes on.
+ */
+typedef struct {
+	char * buf;
+	size_t size;
+	int busy;				// the writer owns buf
+	char path[PATH_MAX];
+} tSnapshot;
+
+// @return the size of a snapshot file
+size_t snapshot_size(tParams * params);
+/**
+ * Copies the thread's state and starts writing it to a temporary file, which is fsync'ed
+ * and renamed over the last snapshot. Skipped while the last one is being written.
+ */
+void snapshot_take(tSnapshot * s, tParams * params, int thread_id, int threads, tPopulation * population,
+		dpqueue_t * queue, ulong generation, ulong last_success_generation, ulong restarts);
+/**
+ * The last snapshot of the run: waits for the writer, then writes the state in the calling
+ * thread and frees the copy.
+ */
+void snapshot_finish(tSnapshot * s, tParams * params, int thread_id, int threads, tPopulation * population,
+		dpqueue_t * queue, ulong generation, ulong last_success_generation, ulong restarts);
+/**
+ * Maps the thread's snapshot as its population and queue, restores its random numbers.
+ */
+void snapshot_load(tParams * params, int thread_id, tPopulation * population, dpqueue_t * queue,
+		ulong * generation, ulong * last_success_generation, ulong * restarts);
+/**
+ * Restores the parameters of the snapshot of thread 0 in output, but the strings.
+ * @return the nr. of threads, which wrote the snapshots
+ */
+int snapshot_params(char * output, tParams * params);
+
+#endif
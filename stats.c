@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <omp.h>
+#include "stats.h"
+#include "common.h"
+
+tStats * stats=NULL;
+
+static volatile sig_atomic_t Requested;	// by SIGUSR1
+
+static char * Counter_names[STATS_COUNTERS]={"evaluations", "steps", "halts", "bounds", "step_limits",
+		"generations", "restarts", "improvements", "screened", "screen_passes", "raced", "race_passes"};
+static char * Phase_names[PHASES]={"mutation", "evaluation", "selection", "migration", "restart", "snapshot"};
+
+static double seconds(struct timespec * from, struct timespec * to) {
+	return to->tv_sec-from->tv_sec + (to->tv_nsec-from->tv_nsec)*1e-9;
+}
+
+// @return the share of the passes, 0 if none was tried
+static double pass_rate(ulong passes, ulong tried) {
+	return tried ? (double)passes/tried : 0;
+}
+
+// the slot of the thread running evolve_turing(), -1 in the threads of the evaluation team
+static int Slot=-1;
+#pragma omp threadprivate(Slot)
+
+void stats_thread(int thread_id) {
+	Slot=thread_id;
+}
+
+/**
+ * The calling thread's counters: its bound slot, which stays in the inactive nested regions,
+ * where each thread is number 0. Else the thread's number in the work stealing team.
+ */
+static tThreadStats * thread_stats(tStats * s) {
+	int i=Slot>=0 ? Slot : omp_get_thread_num();
+	return s->threads_stats + (i<s->threads ? i : 0);
+}
+
+// sums the threads' counters into a line, @param print 1 also prints it
+static void write_line(tStats * s, int print) {
+	ulong counter[STATS_COUNTERS]={0};
+	double time[PHASES]={0}, t, interval;
+	struct timespec now;
+	int i, j;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (i=0; i<s->threads; i++) {
+		for (j=0; j<STATS_COUNTERS; j++)
+			counter[j]+=__atomic_load_n(&s->threads_stats[i].counter[j], __ATOMIC_RELAXED);
+		for (j=0; j<PHASES; j++) {
+			__atomic_load(&s->threads_stats[i].time[j], &t, __ATOMIC_RELAXED);
+			time[j]+=t;
+		}
+	}
+	interval=seconds(&s->last, &now);
+	fprintf(s->f, "%.3lf", seconds(&s->start, &now));
+	for (j=0; j<STATS_COUNTERS; j++) fprintf(s->f, ",%lu", counter[j]);
+	fprintf(s->f, ",%.1lf,%.1lf", (counter[STAT_EVALUATIONS]-s->last_counter[STAT_EVALUATIONS])/interval,
+			(counter[STAT_STEPS]-s->last_counter[STAT_STEPS])/interval);
+	fprintf(s->f, ",%.4lf,%.4lf", pass_rate(counter[STAT_SCREEN_PASSES], counter[STAT_SCREENED]),
+			pass_rate(counter[STAT_RACE_PASSES], counter[STAT_RACED]));
+	for (j=0; j<PHASES; j++) fprintf(s->f, ",%.3lf", time[j]);
+	fprintf(s->f, "\n");
+	fflush(s->f);
+	if (print) {
+		printf("Stats after %.1lf s:", seconds(&s->start, &now));
+		for (j=0; j<STATS_COUNTERS; j++) printf(" %s=%lu", Counter_names[j], counter[j]);
+		printf(", evaluations/s=%.1lf, steps/s=%.1lf", (counter[STAT_EVALUATIONS]-s->last_counter[STAT_EVALUATIONS])/interval,
+				(counter[STAT_STEPS]-s->last_counter[STAT_STEPS])/interval);
+		printf(", screen pass rate=%.4lf, race pass rate=%.4lf, seconds in",
+				pass_rate(counter[STAT_SCREEN_PASSES], counter[STAT_SCREENED]),
+				pass_rate(counter[STAT_RACE_PASSES], counter[STAT_RACED]));
+		for (j=0; j<PHASES; j++) printf(" %s=%.1lf", Phase_names[j], time[j]);
+		printf("\n");
+	}
+	memcpy(s->last_counter, counter, sizeof(counter));
+	s->last=now;
+}
+
+static void * exporter_thread(void * arg) {
+	tStats * s=arg;
+	struct timespec now;
+
+	while (!s->stop) {
+		usleep(STATS_POLL_MS*1000);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (Requested || (s->interval>0 && seconds(&s->last, &now) >= s->interval)) {
+			write_line(s, Requested);
+			Requested=0;
+		}
+	}
+	return NULL;
+}
+
+tStats * stats_init(tParams * params, int threads) {
+	tStats * s;
+	char path[4096];
+	int i;
+
+	snprintf(path, sizeof(path), "%s/%s", params->output, STATS_FILE);
+	if ((s=calloc(1, sizeof(tStats)))==NULL || (s->f=fopen(path, "a"))==NULL)
+		return NULL;
+	s->threads=threads;
+	s->interval=params->stats_interval;
+	if (posix_memalign((void **)&s->threads_stats, 64, threads*sizeof(tThreadStats))) {
+		fprintf(stderr, "Can't allocate memory for the stats!\n");
+		exit(-1);
+	}
+	memset(s->threads_stats, 0, threads*sizeof(tThreadStats));
+	clock_gettime(CLOCK_MONOTONIC, &s->start);
+	s->last=s->start;
+	for (i=0; i<threads; i++) {		// the initial population is evaluated like after a restart
+		s->threads_stats[i].phase=PHASE_RESTART;
+		s->threads_stats[i].last=s->start;
+	}
+	if (ftell(s->f)==0) {
+		fprintf(s->f, "time");
+		for (i=0; i<STATS_COUNTERS; i++) fprintf(s->f, ",%s", Counter_names[i]);
+		fprintf(s->f, ",evaluations_per_s,steps_per_s,screen_pass_rate,race_pass_rate");
+		for (i=0; i<PHASES; i++) fprintf(s->f, ",%s_s", Phase_names[i]);
+		fprintf(s->f, "\n");
+	}
+	if (pthread_create(&s->exporter, NULL, exporter_thread, s)) {
+		fprintf(stderr, "Can't start the stats exporter!\n");
+		exit(-1);
+	}
+	return s;
+}
+
+inline void stats_add(tStats * s, int counter, ulong n) {
+	tThreadStats * t;
+
+	if (s==NULL) return;
+	t=thread_stats(s);
+	__atomic_store_n(&t->counter[counter], t->counter[counter]+n, __ATOMIC_RELAXED);
+}
+
+void stats_run(tStats * s, tStatus * status, int max_steps) {
+	tThreadStats * t;
+	int end;
+
+	if (s==NULL) return;
+	t=thread_stats(s);
+	if (status->error==ERR_BOUNDS) end=STAT_BOUNDS;
+	else if (status->error==ERR_LOOP || status->steps>=max_steps) end=STAT_STEP_LIMITS;
+	else end=STAT_HALTS;
+	__atomic_store_n(&t->counter[end], t->counter[end]+1, __ATOMIC_RELAXED);
+	__atomic_store_n(&t->counter[STAT_STEPS], t->counter[STAT_STEPS]+status->steps, __ATOMIC_RELAXED);
+}
+
+void stats_phase(tStats * s, int phase) {
+	tThreadStats * t;
+	struct timespec now;
+	double time;
+
+	if (s==NULL) return;
+	t=thread_stats(s);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	time=t->time[t->phase]+seconds(&t->last, &now);
+	__atomic_store(&t->time[t->phase], &time, __ATOMIC_RELAXED);
+	t->phase=phase;
+	t->last=now;
+}
+
+void stats_request(int sig) {
+	Requested=1;
+	signal(SIGUSR1, &stats_request);
+}
+
+void stats_close(tStats * s) {
+	s->stop=1;
+	pthread_join(s->exporter, NULL);
+	write_line(s, 0);
+	fclose(s->f);
+}
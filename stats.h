@@ -0,0 +1,75 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <pthread.h>
+#include <time.h>
+#include "evolve_turing.h"
+
+#define STATS_FILE "stats.csv"
+#define STATS_DEFAULT_INTERVAL 10	// seconds
+#define STATS_POLL_MS 100			// the exporter's period of checking for SIGUSR1
+
+enum {
+	STAT_EVALUATIONS,	// of the fitness, incl. the cache hits
+	STAT_STEPS,			// of the runs, incl. those skipped by the loop detection
+	STAT_HALTS,			// the runs which reached a final state
+	STAT_BOUNDS,		// ERR_BOUNDS
+	STAT_STEP_LIMITS,	// the runs which reached (or were found to reach, ERR_LOOP) the step limit
+	STAT_GENERATIONS, STAT_RESTARTS, STAT_IMPROVEMENTS,
+	STAT_SCREENED,		// the kids run on the screening tape, see set_screening()
+	STAT_SCREEN_PASSES,	// of them, the ones evaluated on all the tapes
+	STAT_RACED,			// the kids evaluated on all the tapes against a threshold
+	STAT_RACE_PASSES,	// of them, the ones which reached it
+	STATS_COUNTERS
+};
+
+enum {PHASE_MUTATION, PHASE_EVALUATION, PHASE_SELECTION, PHASE_MIGRATION, PHASE_RESTART, PHASE_SNAPSHOT, PHASES};
+
+/**
+ * The counters of a thread, on their own cache lines. Only the thread writes them,
+ * the exporter reads them without any lock: a sum may miss the latest increments.
+ */
+typedef struct {
+	ulong counter[STATS_COUNTERS];
+	double time[PHASES];	// seconds spent in each phase
+	int phase;				// the current one, since last
+	struct timespec last;
+} __attribute__((aligned(64))) tThreadStats;
+
+/**
+ * The runtime counters of a run, summed over the threads into a line of OUTPUT/stats.csv
+ * every interval seconds, on SIGUSR1 (printed, too) and by stats_close().
+ */
+typedef struct {
+	FILE * f;
+	int threads, interval;
+	tThreadStats * threads_stats;	// [threads]
+	ulong last_counter[STATS_COUNTERS];	// the sums of the last line, for the rates
+	struct timespec start, last;
+	pthread_t exporter;
+	volatile int stop;
+} tStats;
+
+extern tStats * stats;	// NULL = not counted
+
+/**
+ * Opens the stats file in append mode and starts the exporter.
+ * @return NULL if the file can't be opened
+ */
+tStats * stats_init(tParams * params, int threads);
+// binds the calling thread to the counters of thread_id
+void stats_thread(int thread_id);
+// adds n to the counter of the calling thread
+inline void stats_add(tStats * s, int counter, ulong n);
+// counts the run which ended in status
+void stats_run(tStats * s, tStatus * status, int max_steps);
+// the calling thread starts the phase, the time since the last call goes to the previous one
+void stats_phase(tStats * s, int phase);
+// the SIGUSR1 handler: the exporter writes a line now
+void stats_request(int sig);
+/**
+ * Stops the exporter, writes the last line and closes the file.
+ */
+void stats_close(tStats * s);
+
+#endif
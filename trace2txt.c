@@ -0,0 +1,83 @@
+/**
+ * Prints a trace written by replay() (export_gv -t) as text: the table, then for each
+ * tape its input, a line per step (the configuration before it), the final status,
+ * the fitness and the final tape.
+ *
+ * gcc -std=gnu99 -fgnu89-inline -O2 trace2txt.c turing.c turing_jit.c -o trace2txt
+ * ./trace2txt TRACE
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "turing.h"
+#include "evolve_turing.h"
+
+volatile int log_level=LOG_NONE_0;
+
+// @return 0 if the trace ends sooner
+static int read_all(void * buf, size_t size, size_t n, FILE * f) {
+	return fread(buf, size, n, f)==n;
+}
+
+static void print_cells(char * title, schar * cells, int len) {
+	int i;
+
+	printf("%s", title);
+	for (i=0; i<len; i++)
+		printf("%d,", cells[i]);
+	printf("\n");
+}
+
+int main(int argc, char * argv[]) {
+	tTraceHeader header;
+	tTraceTape section;
+	tTraceStep step;
+	tTransTableItem * table;
+	tStatus status;
+	schar * cells;
+	double fitness;
+	int i, j;
+	FILE * f;
+
+	if (argc<2 || (f=fopen(argv[1], "r"))==NULL) {
+		fprintf(stderr, "Usage: %s TRACE\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (!read_all(&header, sizeof(header), 1, f) || strcmp(header.magic, TRACE_MAGIC)) {
+		fprintf(stderr, "%s is not a trace!\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	printf("states=%d, symbols=%d, tapes=%d\n", header.states, header.symbols, header.tapes);
+	table=malloc(header.states*header.symbols*sizeof(tTransTableItem));
+	if (!read_all(table, sizeof(tTransTableItem), header.states*header.symbols, f))
+		goto truncated;
+	for (i=0; i<header.states*header.symbols; i++)
+		printf("S%d, %d -> S%d, %d, %s\n", i/header.symbols, i%header.symbols,
+				TRANS_STATE(table[i]), TRANS_SYMBOL(table[i]), shift2str(TRANS_SHIFT(table[i])));
+	for (i=0; i<header.tapes; i++) {
+		if (!read_all(&section, sizeof(section), 1, f)) goto truncated;
+		cells=malloc(section.input_len);
+		printf("\nTape %d, %d steps\n", i+1, section.steps);
+		if (!read_all(cells, 1, section.input_len, f)) goto truncated;
+		print_cells("input: ", cells, section.input_len);
+		printf("step state head symbol\n");
+		for (j=0; j<section.steps; j++) {
+			if (!read_all(&step, sizeof(step), 1, f)) goto truncated;
+			printf("%d %d %d %d\n", j, step.state, step.head, step.symbol);
+		}
+		if (!read_all(&status, sizeof(status), 1, f) || !read_all(&fitness, sizeof(fitness), 1, f) ||
+				!read_all(cells, 1, section.input_len, f))
+			goto truncated;
+		printf("state=%d, steps=%d, writes=%d, head=%d, head_max=%d, error=%d, fitness=%.9lf\n",
+				status.state, status.steps, status.writes, status.head, status.head_max,
+				status.error, fitness);
+		print_cells("output: ", cells, section.input_len);
+		free(cells);
+	}
+	fclose(f);
+	return EXIT_SUCCESS;
+truncated:
+	fprintf(stderr, "The trace %s is truncated!\n", argv[1]);
+	return EXIT_FAILURE;
+}
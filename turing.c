@@ -1,6 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include "turing.h"
+#include "turing_jit.h"
 #include "common.h"
 
 tTransTableItem * getTransition(tTransitions * t, int state, signed char symbol) {
@@ -19,29 +22,340 @@ inline char * shift2str(tShift shift) {
 	return shifts[shift];
 }
 
+void tape_reserve(tTape * tape, int cells) {
+	int size;
+	schar * buf;
+
+	if (cells > tape->limit) cells=tape->limit;
+	if (cells <= tape->size) return;
+	size=(cells+TAPE_CHUNK-1)/TAPE_CHUNK*TAPE_CHUNK;
+	if (size > tape->limit) size=tape->limit;
+	buf=realloc(tape->content ? tape->content-TAPE_GUARD : NULL, size+2*TAPE_GUARD);
+	if (buf==NULL) {
+		fprintf(stderr, "Can't allocate memory for the tape!\n");
+		exit(-1);
+	}
+	memset(buf+TAPE_GUARD+tape->size, BLANK, size-tape->size);
+	tape->content=buf+TAPE_GUARD;
+	tape->size=size;
+}
+
+int loop_check=1;
+int sweeps=1;
+// the loop detection of turing() and turing_fast(), its buffer is reused
+tLoopCheck Loop;
+#pragma omp threadprivate(Loop)
+
+void loop_check_init(tLoopCheck * l, int steps, int head, int limit) {
+	l->state=-1;
+	l->limit=limit;
+	l->steps=l->start=steps;
+	l->origin=head;
+	l->gap=1;
+	l->next=loop_check ? steps+1 : INT_MAX;
+}
+
+int loop_check_len(tLoopCheck * l, int steps) {
+	int next=steps < INT_MAX-2*l->gap ? steps+2*l->gap : INT_MAX, len;
+
+	// the head moves at most 2 cells per step from its origin
+	len=(next-l->start) < l->limit/2 ? l->origin+2*(next-l->start)+2 : l->limit;
+	return len > l->limit ? l->limit : len;
+}
+
+void loop_check_save(tLoopCheck * l, schar * content, int size, int steps, int writes, int state, int head, ulong hash) {
+	l->steps=steps;
+	l->writes=writes;
+	l->state=state;
+	l->head=head;
+	l->hash=hash;
+	l->len=loop_check_len(l, steps);
+	l->gap*=2;
+	l->next=steps < INT_MAX-l->gap ? steps+l->gap : INT_MAX;
+	if (l->len > l->capacity) {
+		if ((l->content=realloc(l->content, l->len))==NULL) {
+			fprintf(stderr, "Can't allocate memory for the loop detection!\n");
+			exit(-1);
+		}
+		l->capacity=l->len;
+	}
+	if (size > l->len) size=l->len;
+	memcpy(l->content, content, size);
+	memset(l->content+size, BLANK, l->len-size);
+}
+
+/**
+ * Call it when the state and the head equal the saved ones. The tape only grows,
+ * so its cells beyond size were BLANK when saved, too.
+ * @return the loop period in steps, or 0 if the configuration differs
+ */
+int loop_check_period(tLoopCheck * l, schar * content, int size, int steps, ulong hash) {
+	if (steps==l->steps || hash!=l->hash || memcmp(content, l->content, size < l->len ? size : l->len)) return 0;
+	return steps-l->steps;
+}
+
+// skips the whole periods before max_steps and disables further checks
+void loop_check_skip(tLoopCheck * l, int period, int max_steps, int * steps, int * writes) {
+	int periods=(max_steps-*steps)/period;
+	*writes+=periods*(*writes-l->writes);
+	*steps+=periods*period;
+	l->state=-1;
+	l->next=INT_MAX;
+}
+
+void loop_check_free(tLoopCheck * l) {
+	free(l->content);
+	l->content=NULL;
+	l->capacity=0;
+}
+
+// the cells up to head_max may have been written
+static inline void tape_written(tTape * tape, int head_max) {
+	if (head_max >= tape->dirty) tape->dirty=head_max+1;
+}
+
 void turing(tTape * tape, tTransitions * t, int max_steps, tStatus * status) {
 	signed char symbol;			
-	int head=1;		//turing read/write head position=2nd symbol (our tapes must begin with BLANK symbol)
+	int head=status->head;		//turing read/write head position
+	int period, looped=0;
+	ulong hash=0;
+	tLoopCheck * loop=&Loop;
+
+	loop_check_init(loop, status->steps, head, tape->limit);
+	if (head >= tape->size) tape_reserve(tape, head+1);
 	while (status->steps < max_steps && status->state < t->states) {
 	tTransTableItem * trans;
+		if (status->steps==loop->next)
+			loop_check_save(loop, tape->content, tape->size, status->steps, status->writes, status->state, head, hash);
+		else if (status->state==loop->state && head==loop->head &&
+				(period=loop_check_period(loop, tape->content, tape->size, status->steps, hash))) {
+			loop_check_skip(loop, period, max_steps, &status->steps, &status->writes);
+			looped=1;
+			continue;
+		}
 		status->steps++;
 		symbol=tape->content[head];				//this variable is good only for debugging...
 		trans=getTransition(t, status->state, symbol);
-		status->state=trans->state;
-		if (trans->symbol >= 0) {
-			tape->content[head]=trans->symbol;
+		if (t->used) USED_SET(t->used, trans - t->table);
+		status->state=TRANS_STATE(*trans);
+		if (TRANS_SYMBOL(*trans) >= 0) {
+			hash+=LOOP_HASH(symbol, TRANS_SYMBOL(*trans), head);
+			tape->content[head]=TRANS_SYMBOL(*trans);
 			status->writes++;
 			if (head>status->head_max) status->head_max=head;
 		}
-		switch (trans->shift) {
+		switch (TRANS_SHIFT(*trans)) {
 			case L: head--; break;
 			case R: head++; break;
 			case RR: head+=2; break;
 		}
-		if (head<0 || head>=TAPE_LEN) {
+		if (head<0 || head>=tape->limit) {
 			if (log_level>=LOG_DEBUG_3) fprintf(stderr, "Head out of bounds!\n");
 			status->error=ERR_BOUNDS;
+			status->head=head;
+			tape_written(tape, status->head_max);
 			return;
 		}
+		if (head >= tape->size) tape_reserve(tape, head+1);
 	} 					// while(...) - the main loop;
+	status->head=head;
+	tape_written(tape, status->head_max);
+	if (looped) status->error=ERR_LOOP;
+}
+
+/**
+ * Fast engine: the transition table is validated and flattened once per call,
+ * so the main loop does no bounds checks, no multiplication and no function calls.
+ * The write is unconditional: an item which doesn't write stores the symbol
+ * of its own column. Every item carries an opcode - its shift, or halt, or guard -
+ * which is dispatched by computed goto (GNU C) from the end of each handler,
+ * so that each shift has its own well predicted indirect jump. Other compilers
+ * get the same handlers in a switch. The step limit and the loop detection
+ * share one test per step, the rest of their work is on the slow path.
+ */
+typedef struct {
+	unsigned short next;	// offset of the next state's row in the flattened table, the final state for OP_HALT
+	schar symbol;	// symbol to store, for E it's the symbol just read
+	schar change;	// symbol - the symbol read, for the loop detection hash
+	uchar write;	// 1 when the symbol is really written (counts in writes and head_max)
+	uchar used;		// set when the item is read
+	uchar shift;	// the shift
+	uchar op;		// the shift again, or OP_HALT, OP_GUARD, OP_SWEEP_R or OP_SWEEP_L
+} tFlatTransition;
+
+enum {OP_HALT=SHIFTS, OP_GUARD, OP_SWEEP_R, OP_SWEEP_L};
+
+// the length of the run of the symbol from cells[0] right, at most n cells
+static inline int run_right(schar * cells, schar symbol, int n) {
+	int i=0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	ulong pattern=0x0101010101010101UL*(uchar)symbol, word;
+
+	for (; i+8<=n; i+=8) {
+		memcpy(&word, cells+i, 8);
+		if ((word^=pattern)) return i+__builtin_ctzl(word)/8;
+	}
+#endif
+	while (i<n && cells[i]==symbol) i++;
+	return i;
+}
+
+// the length of the run of the symbol from cells[0] left, at most n cells
+static inline int run_left(schar * cells, schar symbol, int n) {
+	int i=0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	ulong pattern=0x0101010101010101UL*(uchar)symbol, word;
+
+	for (; i+8<=n; i+=8) {
+		memcpy(&word, cells-i-7, 8);
+		if ((word^=pattern)) return i+__builtin_clzl(word)/8;
+	}
+#endif
+	while (i<n && cells[-i]==symbol) i++;
+	return i;
+}
+
+/**
+ * The machine runs on the tape itself, with the guard zones (TAPE_GUARD cells before
+ * the content and at its end) filled with the extra symbol "symbols", whose column
+ * of the flattened table holds OP_GUARD items only. The head thus can't leave
+ * the allocated cells unnoticed: L moves it at most 1 cell left and RR at most 2 cells
+ * right from a valid position. At the end guard, the tape grows, until its limit.
+ */
+#define GUARD_LEN TAPE_GUARD
+
+#define FAST_NAME turing_fast
+#define FAST_STATES t->states
+#define FAST_SYMBOLS t->symbols
+#include "turing_fast.h"
+
+// the kernels of KERNEL_SHAPES
+#define FAST_NAME turing_fast_8x4
+#define FAST_STATES 8
+#define FAST_SYMBOLS 4
+#include "turing_fast.h"
+#define FAST_NAME turing_fast_10x4
+#define FAST_STATES 10
+#define FAST_SYMBOLS 4
+#include "turing_fast.h"
+#define FAST_NAME turing_fast_12x4
+#define FAST_STATES 12
+#define FAST_SYMBOLS 4
+#include "turing_fast.h"
+#define FAST_NAME turing_fast_16x4
+#define FAST_STATES 16
+#define FAST_SYMBOLS 4
+#include "turing_fast.h"
+
+static tTuringEngine Warmup=turing_fast;	// the fast kernel of the JIT engine
+
+void turing_jit(tTape * tape, tTransitions * t, int max_steps, tStatus * status) {
+	int states=t->states, symbols=t->symbols, end, period, looped=0, reason, i, error=status->error;
+	uchar used[states*symbols], bad=0;
+	schar * cell;
+	tJitCode code;
+	tJitContext c;
+	tLoopCheck * loop=&Loop;
+
+	// the short runs don't pay for the compilation, nor do the rest of the warm-up
+	if (max_steps-status->steps <= 2*JIT_HOT_STEPS) {
+		Warmup(tape, t, max_steps, status);
+		return;
+	}
+	Warmup(tape, t, status->steps+JIT_HOT_STEPS, status);
+	if (status->state >= states || status->error==ERR_BOUNDS)
+		return;
+	if (status->error==ERR_LOOP && error!=ERR_LOOP) {	// a loop, found again soon by the fast engine
+		Warmup(tape, t, max_steps, status);
+		return;
+	}
+	for (i=0; i<states*symbols; i++)
+		bad|=TRANS_SYMBOL(t->table[i]) >= symbols;
+	for (i=0; i<tape->dirty; i++)
+		bad|=(uchar)tape->content[i] >= symbols;
+	if (bad || (code=jit_compile(t))==NULL) {
+		Warmup(tape, t, max_steps, status);
+		return;
+	}
+	memset(used, 0, sizeof(used));
+	c.head=status->head;
+	c.steps=status->steps;
+	c.writes=status->writes;
+	c.head_max=status->head_max;
+	c.hash=0;
+	c.loop_state=-1;
+	c.loop_head=0;
+	c.used=used;
+	c.state=status->state;
+	if (c.head >= tape->size) tape_reserve(tape, c.head+1);
+// (re)places the guards around the allocated cells of the tape
+#define GUARDS() cell=c.cells=tape->content; \
+				end=tape->size < tape->limit ? tape->size : tape->limit; \
+				memset(cell-GUARD_LEN, symbols, GUARD_LEN); \
+				memset(cell+end, symbols, GUARD_LEN)
+	GUARDS();
+	loop_check_init(loop, c.steps, c.head, tape->limit);
+	for (;;) {		// the slow path of the fast engine, between the runs of the code
+		if (c.steps >= max_steps) break;
+		if (c.steps == loop->next) {
+			loop_check_save(loop, cell, end, c.steps, c.writes, c.state, c.head, c.hash);
+			c.loop_state=c.state;
+			c.loop_head=c.head;
+		} else if (c.state==c.loop_state && c.head==c.loop_head &&
+				(period=loop_check_period(loop, cell, end, c.steps, c.hash))) {
+			int steps=c.steps, writes=c.writes;
+			loop_check_skip(loop, period, max_steps, &steps, &writes);
+			c.steps=steps;
+			c.writes=writes;
+			c.loop_state=-1;
+			looped=1;
+		}
+		c.limit=loop->next < max_steps ? loop->next : max_steps;
+		if (c.steps >= c.limit) break;
+		while ((reason=code(&c))==JIT_GUARD) {	// the head moved out of the allocated cells
+			if (c.head<0 || c.head>=tape->limit) goto done;
+			tape_reserve(tape, c.head+1);
+			GUARDS();
+		}
+#undef GUARDS
+		if (reason==JIT_HALT) goto finish;
+	}
+done:
+	if (looped) status->error=ERR_LOOP;
+finish:
+	status->state=c.state;
+	memset(cell+end, BLANK, GUARD_LEN);
+	if (c.head<0 || c.head>=tape->limit) {
+		if (log_level>=LOG_DEBUG_3) fprintf(stderr, "Head out of bounds!\n");
+		status->error=ERR_BOUNDS;
+	}
+	if (t->used)
+		for (i=0; i<states*symbols; i++)
+			if (used[i]) USED_SET(t->used, i);
+	status->head=c.head;
+	status->steps=c.steps;
+	status->writes=c.writes;
+	status->head_max=c.head_max;
+	tape_written(tape, c.head_max);
+}
+
+tTuringEngine turing_engine=turing;
+
+void set_turing_engine(tEngine engine, int states, int symbols) {
+	switch (engine) {
+		case ENGINE_FAST:
+		case ENGINE_BATCH:
+		case ENGINE_JIT:
+			turing_engine=turing_fast;
+#define FAST_KERNEL(STATES, SYMBOLS) \
+			if (states==STATES && symbols==SYMBOLS) turing_engine=turing_fast_##STATES##x##SYMBOLS;
+			KERNEL_SHAPES(FAST_KERNEL)
+#undef FAST_KERNEL
+			if (engine==ENGINE_JIT) {
+				Warmup=turing_engine;
+				turing_engine=turing_jit;
+			}
+			break;
+		default: turing_engine=turing;
+	}
 }
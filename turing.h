@@ -3,7 +3,7 @@
 
 enum { E=-1, BLANK};
 
-enum {ERR_BOUNDS=-1};
+enum {ERR_BOUNDS=-1, ERR_LOOP=-2};
 typedef unsigned char uchar;
 typedef signed char schar;
 typedef unsigned long ulong;
@@ -11,30 +11,131 @@ typedef enum {R, L, RR, N} tShift;
 
 #define SHIFTS 4
 
-typedef struct {
-		unsigned char state;
-		signed char symbol;
-		unsigned char shift;
-}  tTransTableItem; //mathematically said, we define the codomain of the state transition function here
+/**
+ * Mathematically said, we define the codomain of the state transition function here,
+ * packed into 16 bits: the next state (8 bits), the written symbol+1 (6 bits, 0 is E)
+ * and the shift (2 bits). The tables are copied, hashed and compared as plain arrays.
+ */
+typedef unsigned short tTransTableItem;
+
+#define TRANS_MAX_STATES 255	// the final state is nr. "states"
+#define TRANS_MAX_SYMBOLS 63
+#define TRANS_ITEM(state, symbol, shift)	((tTransTableItem)((state)<<8 | ((symbol)+1)<<2 | (shift)))
+#define TRANS_STATE(item)	((item)>>8)
+#define TRANS_SYMBOL(item)	((int)((item)>>2 & 63)-1)
+#define TRANS_SHIFT(item)	((item) & 3)
 
 typedef struct {
 	int	states; 	// nr. of states (including start, excluding "end" and "error")
 	int symbols;	// nr. of input symbols (including BLANK, excluding "E"mpty)
 	tTransTableItem * table;
+	ulong * used;	// if not NULL, the engines set the bits of the table items they read
 } tTransitions;
 
-#define TAPE_LEN 1000
+// the bitmap of used table items
+#define USED_WORDS(table_size) (((table_size)+63)/64)
+#define USED_SET(used, i) ((used)[(i)/64] |= 1UL << (i)%64)
+#define USED_GET(used, i) ((used)[(i)/64] >> (i)%64 & 1)
 
+#define TAPE_LEN 1000		// the least tape limit
+#define TAPE_CHUNK 256		// the work tapes grow by whole chunks
+#define TAPE_GUARD 2		// cells allocated before and after the content, for the engines' guards
+// the head may use as many cells again as the input has, but at least TAPE_LEN
+#define TAPE_LIMIT(input_len) ((input_len) < TAPE_LEN/2 ? TAPE_LEN : 2*(input_len))
+
+/**
+ * An input tape has just its content and input_len. A work tape is allocated
+ * by tape_reserve(), the engines grow it on demand up to its limit: the cells from size on
+ * are BLANK, so are the ones from dirty on, which are cleared by the next init_tape().
+ */
 typedef struct {
-	schar content[TAPE_LEN];// array containing the tape symbols
+	schar * content;		// array containing the tape symbols
 	int input_len;			// length of the initial symbols sequence
 	void * metrics;			// possibly any metrics of the tape content
+	int size;				// the allocated cells
+	int dirty;				// the cells which may differ from BLANK
+	int limit;				// the head beyond it is out of the tape (ERR_BOUNDS)
 } tTape;
 
+// grows the work tape to at least min(cells, limit) cells
+void tape_reserve(tTape * tape, int cells);
+
+#define HEAD_START 1	// the head starts at the 2nd symbol (our tapes must begin with BLANK symbol)
+
+// the machine's configuration: the engines continue from it and update it
 typedef struct {
-	int state, steps, writes, error, head_max;
+	int state, steps, writes, error, head_max,
+		head;		// HEAD_START for a new run
 } tStatus;
 
+/**
+ * Loop detection (Brent): the configuration is saved after 1, 2, 4, 8... steps
+ * and each following configuration is compared with the saved one - state and head first,
+ * then a hash of the tape changes, then the tape itself. A repeated configuration
+ * means the machine would run until max_steps, so the whole periods are skipped
+ * and only the rest is simulated: the resulting tape and status are the same
+ * as without the detection, except status->error=ERR_LOOP.
+ */
+typedef struct {
+	int steps, writes, state, head;	// the saved configuration
+	int next, gap;					// steps of the next saving, the current distance
+	int start, origin;				// steps and head at the start of the run
+	int len;						// the saved part of the tape, the only part the head can reach before next
+	int limit;						// of the tape
+	ulong hash;						// sum of (new-old symbol)*(position+1) over all writes
+	schar * content;				// [capacity], kept for the next runs
+	int capacity;
+} tLoopCheck;
+
+extern int loop_check;	// 0 disables the loop detection
+
+/**
+ * Sweeps: an item which keeps the state and the symbol and moves the head by one cell
+ * does so over the whole run of its symbol. The fast engine (and the JIT's warm-up) then
+ * finds the end of the run by comparing 8 cells at once, and counts its steps and writes
+ * in one go. The results are the same, step by step.
+ */
+extern int sweeps;	// 0 runs the sweeps step by step
+
+#define LOOP_HASH(old_symbol, new_symbol, head) ((ulong)((new_symbol)-(old_symbol))*((head)+1))
+
+void loop_check_init(tLoopCheck * l, int steps, int head, int limit);
+// @return the cells, which loop_check_save() at steps keeps for the comparisons
+int loop_check_len(tLoopCheck * l, int steps);
+// size: the cells of content, the ones beyond are BLANK
+void loop_check_save(tLoopCheck * l, schar * content, int size, int steps, int writes, int state, int head, ulong hash);
+int loop_check_period(tLoopCheck * l, schar * content, int size, int steps, ulong hash);
+void loop_check_skip(tLoopCheck * l, int period, int max_steps, int * steps, int * writes);
+void loop_check_free(tLoopCheck * l);
+
+typedef enum {ENGINE_REFERENCE, ENGINE_FAST, ENGINE_BATCH, ENGINE_JIT, ENGINES} tEngine;
+typedef void (*tTuringEngine)(tTape * tape, tTransitions * t, int max_steps, tStatus * status);
+extern tTuringEngine turing_engine;	// the engine used by the fitness evaluation
+
 void turing(tTape * tape, tTransitions * t, int max_steps, tStatus * status);
+void turing_fast(tTape * tape, tTransitions * t, int max_steps, tStatus * status);
+
+/**
+ * JIT engine: a run starts on the fast engine, after JIT_HOT_STEPS steps the machine
+ * is compiled to native code (turing_jit.h) and continues there, with the fast engine's
+ * guards and slow path. Without the JIT (not x86-64), the run stays on the fast engine.
+ * The same results as turing(), but the loop detection starts again after the warm-up,
+ * so a loop may be flagged (ERR_LOOP) where turing() doesn't find it, or vice versa.
+ */
+#define JIT_HOT_STEPS 16384
+void turing_jit(tTape * tape, tTransitions * t, int max_steps, tStatus * status);
+
+/**
+ * The (states, symbols) shapes with kernels specialized at compile time: the fast engine,
+ * the mutation and the genome hash. X(STATES, SYMBOLS) is expanded for each of them,
+ * the other shapes get the generic code. turing.c includes turing_fast.h for each, too.
+ */
+#define KERNEL_SHAPES(X) X(8, 4) X(10, 4) X(12, 4) X(16, 4)
+
+/**
+ * Selects the engine, and its kernel for the machines of the shape (they can
+ * still have another shape, they just don't run on the specialized kernel).
+ */
+void set_turing_engine(tEngine engine, int states, int symbols);
 inline char * shift2str(tShift shift);
 #endif
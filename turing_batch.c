@@ -0,0 +1,451 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+#include "turing.h"
+#include "turing_batch.h"
+#include "common.h"
+
+/**
+ * Lockstep batch engine. Each lane gets its own flattened table, packed
+ * into 32-bit items of one shared array, and its own guarded tape, which is
+ * a slice of one shared buffer, as long as the longest tape limit. A step of all lanes is then two gathers
+ * (the symbols under the heads and the table items) and a few vector
+ * additions; only the tape writes are done lane by lane, because there is
+ * no byte scatter. Lanes that halt, leave the tape or reach max_steps
+ * are retired by a rare scalar path, which loads the next waiting machine
+ * into the lane, so the lanes stay busy while the run times differ.
+ * The loop detection of turing() runs per lane, too: the vector part only
+ * compares state and head with the saved ones and keeps a 32-bit tape hash,
+ * the saving and the tape comparison are on the scalar path.
+ * The items read are marked in used, parallel to flat, for tTransitions.used.
+ */
+#define GUARD_LEN 2
+#define STRIDE_EXTRA (2*GUARD_LEN + 4)	// +4: 32-bit gather of the last guard cell stays inside
+
+// the packed table item
+#define I_NEXT		0x7FFFF		// bits 0..18: the next state's row in flat, or the final state for I_HALT
+#define I_SYMBOL	19			// bits 19..25: the symbol to store (the one read, if there is no write)
+#define I_DELTA		26			// bits 26..27: head delta+1
+#define I_WRITE		(1<<28)
+#define I_HALT		(1<<29)
+#define I_GUARD		(1<<30)
+#define SYMBOL(e)	((e) >> I_SYMBOL & 0x7F)
+#define DELTA(e)	(((e) >> I_DELTA & 3) - 1)
+
+static const int shift_delta[SHIFTS] = {1, -1, 2, 0};
+
+typedef struct {
+	int * flat;						// flattened tables of all the lanes
+	uchar * used;					// 1 for the items of flat read by the lanes
+	int table_size;					// space for one lane's table in flat
+	int active;						// bit mask of running lanes
+	int max_steps;
+	int next, n;					// the next waiting machine, nr. of machines
+	tTape * tapes_in;				// the machines and their tapes, see turing_batch()
+	tTransitions * t;
+	tStatus * status_in;
+	int base[BATCH_MAX_LANES],		// the first item of each lane's table in flat
+		cols[BATCH_MAX_LANES];
+	int row[BATCH_MAX_LANES],		// lane registers; heads are offsets into tapes
+		head[BATCH_MAX_LANES],
+		steps[BATCH_MAX_LANES],
+		writes[BATCH_MAX_LANES],
+		head_max[BATCH_MAX_LANES],
+		limit[BATCH_MAX_LANES],		// steps of the next scalar check: max_steps or the loop.next
+		loop_row[BATCH_MAX_LANES],	// the saved configuration of the loop detection, -1=none
+		loop_head[BATCH_MAX_LANES],
+		hash[BATCH_MAX_LANES],
+		looped[BATCH_MAX_LANES];
+	tLoopCheck loop[BATCH_MAX_LANES];
+	tTape * tape[BATCH_MAX_LANES];
+	tTransitions * trans[BATCH_MAX_LANES];
+	tStatus * status[BATCH_MAX_LANES];
+	int end[BATCH_MAX_LANES],		// the end guard of each lane's tape: its limit
+		dirty[BATCH_MAX_LANES];		// its cells which may differ from BLANK
+	int stride;
+	schar * tapes;					// [lanes*stride]
+} tBatch;
+
+static int lane_origin(tBatch * b, int lane) {
+	return lane*b->stride + GUARD_LEN;
+}
+
+/**
+ * Flattens the table of the machine into the lane's part of flat and copies its tape.
+ * @return 1 if the lane has to run, 0 if the machine is already done
+ */
+static int load_machine(tBatch * b, int lane, int machine) {
+	tTape * tape=b->tapes_in+machine;
+	tTransitions * t=b->t+machine;
+	tStatus * status=b->status_in+machine;
+	int states=t->states, symbols=t->symbols, cols=symbols+1, i, st, sy,
+		base=lane*b->table_size, * e=b->flat+base;
+	tTransTableItem * trans=t->table;
+	uchar bad=0;
+	schar * cell=b->tapes+lane_origin(b, lane);
+
+	if (status->state >= states) return 0;
+	for (i=0; i<states*symbols; i++)
+		bad|=TRANS_SYMBOL(trans[i]) >= symbols;
+	for (i=0; i<tape->dirty; i++)
+		bad|=(uchar)tape->content[i] >= symbols;
+	if (bad) {						// unknown symbols are left to the reference engine
+		turing(tape, t, b->max_steps, status);
+		return 0;
+	}
+	for (st=0; st<states; st++, e++) {
+		for (sy=0; sy<symbols; sy++, e++, trans++) {
+			*e=(TRANS_SYMBOL(*trans) >= 0 ? TRANS_SYMBOL(*trans) : sy) << I_SYMBOL
+				| (shift_delta[TRANS_SHIFT(*trans)]+1) << I_DELTA;
+			if (TRANS_SYMBOL(*trans) >= 0) *e|=I_WRITE;
+			if (TRANS_STATE(*trans) >= states) *e|=I_HALT | TRANS_STATE(*trans);
+			else *e|=base + TRANS_STATE(*trans)*cols;
+		}
+		*e=I_GUARD;
+	}
+	memset(b->used+base, 0, b->table_size);
+	// the lane's cells are BLANK from its dirty on, the tape's from its dirty on
+	memset(cell-GUARD_LEN, symbols, GUARD_LEN);
+	memset(cell+b->end[lane], BLANK, GUARD_LEN);
+	memcpy(cell, tape->content, tape->dirty);
+	if (b->dirty[lane] > tape->dirty)
+		memset(cell+tape->dirty, BLANK, b->dirty[lane]-tape->dirty);
+	b->dirty[lane]=tape->dirty;
+	b->end[lane]=tape->limit;
+	memset(cell+tape->limit, symbols, GUARD_LEN);
+
+	b->base[lane]=base;
+	b->cols[lane]=cols;
+	b->row[lane]=base + status->state*cols;
+	b->head[lane]=lane_origin(b, lane) + status->head;
+	b->steps[lane]=status->steps;
+	b->writes[lane]=status->writes;
+	b->head_max[lane]=lane_origin(b, lane) + status->head_max;
+	b->hash[lane]=0;
+	b->looped[lane]=0;
+	b->loop_row[lane]=-1;
+	loop_check_init(b->loop+lane, status->steps, status->head, tape->limit);
+	b->limit[lane]=b->loop[lane].next < b->max_steps ? b->loop[lane].next : b->max_steps;
+	b->tape[lane]=tape;
+	b->trans[lane]=t;
+	b->status[lane]=status;
+	return 1;
+}
+
+// loads waiting machines into the lane, until one of them has to run
+static void load_lane(tBatch * b, int lane) {
+	while (b->next < b->n)
+		if (load_machine(b, lane, b->next++)) {
+			b->active|=1<<lane;
+			return;
+		}
+}
+
+static void retire_lane(tBatch * b, int lane, int state) {
+	tStatus * status=b->status[lane];
+	tTransitions * t=b->trans[lane];
+	int head=b->head[lane]-lane_origin(b, lane), st, sy;
+	uchar * used=b->used+b->base[lane];
+
+	status->state=state;
+	status->steps=b->steps[lane];
+	status->writes=b->writes[lane];
+	status->head_max=b->head_max[lane]-lane_origin(b, lane);
+	status->head=head;
+	if (b->looped[lane]) status->error=ERR_LOOP;
+	if (head<0 || head>=b->end[lane]) {
+		if (log_level>=LOG_DEBUG_3) fprintf(stderr, "Head out of bounds!\n");
+		status->error=ERR_BOUNDS;
+	}
+	// nothing is written beyond head_max
+	if (status->head_max >= b->dirty[lane]) b->dirty[lane]=status->head_max+1;
+	tape_reserve(b->tape[lane], b->dirty[lane]);
+	memcpy(b->tape[lane]->content, b->tapes+lane_origin(b, lane), b->dirty[lane]);
+	b->tape[lane]->dirty=b->dirty[lane];
+	if (t->used)
+		for (st=0; st<t->states; st++, used++)
+			for (sy=0; sy<t->symbols; sy++, used++)
+				if (*used) USED_SET(t->used, st*t->symbols+sy);
+	b->active&=~(1<<lane);
+	load_lane(b, lane);
+}
+
+/**
+ * The rare path of a lane, which makes one whole step of it: the lane reached
+ * max_steps or the loop detection needs to save or compare the configuration,
+ * the lane enters a final state or its previous step moved the head out of the tape.
+ */
+static void special_lane(tBatch * b, int lane) {
+	int e, period, row_state=(b->row[lane]-b->base[lane])/b->cols[lane];
+	tLoopCheck * loop=b->loop+lane;
+	schar * cell=b->tapes+lane_origin(b, lane);
+
+	if (b->steps[lane] >= b->max_steps) {
+		retire_lane(b, lane, row_state);
+		return;
+	}
+	if (b->steps[lane] == loop->next) {
+		loop_check_save(loop, cell, b->end[lane], b->steps[lane], b->writes[lane], b->row[lane], b->head[lane], (uint)b->hash[lane]);
+		b->loop_row[lane]=b->row[lane];
+		b->loop_head[lane]=b->head[lane];
+	} else if (b->row[lane]==b->loop_row[lane] && b->head[lane]==b->loop_head[lane] &&
+			(period=loop_check_period(loop, cell, b->end[lane], b->steps[lane], (uint)b->hash[lane]))) {
+		loop_check_skip(loop, period, b->max_steps, b->steps+lane, b->writes+lane);
+		b->loop_row[lane]=-1;
+		b->looped[lane]=1;
+		if (b->steps[lane] >= b->max_steps) {
+			retire_lane(b, lane, row_state);
+			return;
+		}
+	}
+	b->limit[lane]=loop->next < b->max_steps ? loop->next : b->max_steps;
+	e=b->flat[b->row[lane] + b->tapes[b->head[lane]]];
+	if (e & I_GUARD) {
+		retire_lane(b, lane, row_state);
+		return;
+	}
+	b->used[b->row[lane] + b->tapes[b->head[lane]]]=1;
+	b->steps[lane]++;
+	b->hash[lane]+=(SYMBOL(e) - b->tapes[b->head[lane]])*b->head[lane];
+	b->tapes[b->head[lane]]=SYMBOL(e);
+	if (e & I_WRITE) {
+		b->writes[lane]++;
+		if (b->head[lane] > b->head_max[lane]) b->head_max[lane]=b->head[lane];
+	}
+	b->head[lane]+=DELTA(e);
+	if (e & I_HALT)
+		retire_lane(b, lane, e & I_NEXT);
+	else
+		b->row[lane]=e & I_NEXT;
+}
+
+// plain C lanes: no SIMD, but independent dependency chains interleaved
+static void run_generic(tBatch * b, int lanes) {
+	int lane, e;
+	while (b->active) {
+		for (lane=0; lane<lanes; lane++) {
+			if (!(b->active & 1<<lane)) continue;
+			e=b->flat[b->row[lane] + b->tapes[b->head[lane]]];
+			if (b->steps[lane] >= b->limit[lane] || e & (I_HALT | I_GUARD) ||
+					(b->row[lane]==b->loop_row[lane] && b->head[lane]==b->loop_head[lane])) {
+				special_lane(b, lane);
+				continue;
+			}
+			b->used[b->row[lane] + b->tapes[b->head[lane]]]=1;
+			b->steps[lane]++;
+			b->hash[lane]+=(SYMBOL(e) - b->tapes[b->head[lane]])*b->head[lane];
+			b->tapes[b->head[lane]]=SYMBOL(e);
+			if (e & I_WRITE) {
+				b->writes[lane]++;
+				if (b->head[lane] > b->head_max[lane]) b->head_max[lane]=b->head[lane];
+			}
+			b->head[lane]+=DELTA(e);
+			b->row[lane]=e & I_NEXT;
+		}
+	}
+}
+
+#ifdef __x86_64__
+__attribute__((target("avx2")))
+static void run_avx2(tBatch * b) {
+	__m256i row, head, steps, writes, head_max, limit, loop_row, loop_head, hash,
+			active, e, sym, symbol, item, w,
+			byte=_mm256_set1_epi32(0xFF),
+			one=_mm256_set1_epi32(1),
+			three=_mm256_set1_epi32(3),
+			symbol_mask=_mm256_set1_epi32(0x7F),
+			write=_mm256_set1_epi32(I_WRITE),
+			next=_mm256_set1_epi32(I_NEXT),
+			special=_mm256_set1_epi32(I_HALT | I_GUARD),
+			lane_bits=_mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	int e_lanes[8], head_lanes[8], item_lanes[8], mask, lane;
+
+	#define LOAD() \
+		row=_mm256_loadu_si256((__m256i *)b->row); \
+		head=_mm256_loadu_si256((__m256i *)b->head); \
+		steps=_mm256_loadu_si256((__m256i *)b->steps); \
+		writes=_mm256_loadu_si256((__m256i *)b->writes); \
+		head_max=_mm256_loadu_si256((__m256i *)b->head_max); \
+		limit=_mm256_loadu_si256((__m256i *)b->limit); \
+		loop_row=_mm256_loadu_si256((__m256i *)b->loop_row); \
+		loop_head=_mm256_loadu_si256((__m256i *)b->loop_head); \
+		hash=_mm256_loadu_si256((__m256i *)b->hash); \
+		active=_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(b->active), lane_bits), lane_bits)
+	#define STORE() \
+		_mm256_storeu_si256((__m256i *)b->row, row); \
+		_mm256_storeu_si256((__m256i *)b->head, head); \
+		_mm256_storeu_si256((__m256i *)b->steps, steps); \
+		_mm256_storeu_si256((__m256i *)b->writes, writes); \
+		_mm256_storeu_si256((__m256i *)b->head_max, head_max); \
+		_mm256_storeu_si256((__m256i *)b->hash, hash)
+
+	LOAD();
+	while (b->active) {
+		sym=_mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (int *)b->tapes, head, active, 1);
+		sym=_mm256_and_si256(sym, byte);
+		item=_mm256_add_epi32(row, sym);
+		e=_mm256_mask_i32gather_epi32(_mm256_setzero_si256(), b->flat, item, active, 4);
+		// lanes at their limit or at the saved configuration, plus the lanes which read a halting or guard item
+		mask=_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(active, _mm256_or_si256(
+				_mm256_xor_si256(_mm256_cmpgt_epi32(limit, steps), _mm256_cmpeq_epi32(one, one)),
+				_mm256_and_si256(_mm256_cmpeq_epi32(row, loop_row), _mm256_cmpeq_epi32(head, loop_head))))));
+		mask|=~_mm256_movemask_ps(_mm256_castsi256_ps(
+				_mm256_cmpeq_epi32(_mm256_and_si256(e, special), _mm256_setzero_si256())))
+			& b->active;
+		if (mask) {
+			STORE();
+			for (lane=0; lane<8; lane++)
+				if (mask & 1<<lane) special_lane(b, lane);
+			LOAD();
+			continue;
+		}
+		symbol=_mm256_and_si256(_mm256_srli_epi32(e, I_SYMBOL), symbol_mask);
+		_mm256_storeu_si256((__m256i *)e_lanes, symbol);
+		_mm256_storeu_si256((__m256i *)head_lanes, head);
+		_mm256_storeu_si256((__m256i *)item_lanes, item);
+		for (lane=0; lane<8; lane++)
+			if (b->active & 1<<lane) {
+				b->tapes[head_lanes[lane]]=e_lanes[lane];
+				b->used[item_lanes[lane]]=1;
+			}
+		hash=_mm256_add_epi32(hash, _mm256_mullo_epi32(_mm256_sub_epi32(symbol, sym), head));
+		steps=_mm256_add_epi32(steps, one);
+		w=_mm256_cmpeq_epi32(_mm256_and_si256(e, write), write);
+		writes=_mm256_sub_epi32(writes, w);		// w is -1 in the writing lanes
+		head_max=_mm256_blendv_epi8(head_max, _mm256_max_epi32(head_max, head), w);
+		head=_mm256_add_epi32(head, _mm256_sub_epi32(_mm256_and_si256(_mm256_srli_epi32(e, I_DELTA), three), one));
+		row=_mm256_and_si256(e, next);
+	}
+	#undef LOAD
+	#undef STORE
+}
+
+__attribute__((target("avx512f")))
+static void run_avx512(tBatch * b) {
+	__m512i row, head, steps, writes, head_max, limit, loop_row, loop_head, hash,
+			e, sym, symbol, item,
+			byte=_mm512_set1_epi32(0xFF),
+			one=_mm512_set1_epi32(1),
+			three=_mm512_set1_epi32(3),
+			symbol_mask=_mm512_set1_epi32(0x7F),
+			next=_mm512_set1_epi32(I_NEXT),
+			special=_mm512_set1_epi32(I_HALT | I_GUARD),
+			write=_mm512_set1_epi32(I_WRITE);
+	__mmask16 active, w;
+	int e_lanes[16], head_lanes[16], item_lanes[16], mask, lane;
+
+	#define LOAD() \
+		row=_mm512_loadu_si512(b->row); \
+		head=_mm512_loadu_si512(b->head); \
+		steps=_mm512_loadu_si512(b->steps); \
+		writes=_mm512_loadu_si512(b->writes); \
+		head_max=_mm512_loadu_si512(b->head_max); \
+		limit=_mm512_loadu_si512(b->limit); \
+		loop_row=_mm512_loadu_si512(b->loop_row); \
+		loop_head=_mm512_loadu_si512(b->loop_head); \
+		hash=_mm512_loadu_si512(b->hash); \
+		active=b->active
+	#define STORE() \
+		_mm512_storeu_si512(b->row, row); \
+		_mm512_storeu_si512(b->head, head); \
+		_mm512_storeu_si512(b->steps, steps); \
+		_mm512_storeu_si512(b->writes, writes); \
+		_mm512_storeu_si512(b->head_max, head_max); \
+		_mm512_storeu_si512(b->hash, hash)
+
+	LOAD();
+	while (active) {
+		sym=_mm512_mask_i32gather_epi32(_mm512_setzero_si512(), active, head, b->tapes, 1);
+		sym=_mm512_and_si512(sym, byte);
+		item=_mm512_add_epi32(row, sym);
+		e=_mm512_mask_i32gather_epi32(_mm512_setzero_si512(), active, item, b->flat, 4);
+		mask=_mm512_mask_cmpge_epi32_mask(active, steps, limit)
+			| _mm512_mask_test_epi32_mask(active, e, special)
+			| _mm512_mask_cmpeq_epi32_mask(_mm512_mask_cmpeq_epi32_mask(active, row, loop_row), head, loop_head);
+		if (mask) {
+			STORE();
+			for (lane=0; lane<16; lane++)
+				if (mask & 1<<lane) special_lane(b, lane);
+			LOAD();
+			continue;
+		}
+		symbol=_mm512_and_si512(_mm512_srli_epi32(e, I_SYMBOL), symbol_mask);
+		_mm512_storeu_si512(e_lanes, symbol);
+		_mm512_storeu_si512(head_lanes, head);
+		_mm512_storeu_si512(item_lanes, item);
+		for (lane=0; lane<16; lane++)
+			if (active & 1<<lane) {
+				b->tapes[head_lanes[lane]]=e_lanes[lane];
+				b->used[item_lanes[lane]]=1;
+			}
+		hash=_mm512_add_epi32(hash, _mm512_mullo_epi32(_mm512_sub_epi32(symbol, sym), head));
+		steps=_mm512_add_epi32(steps, one);
+		w=_mm512_test_epi32_mask(e, write);
+		writes=_mm512_mask_add_epi32(writes, w, writes, one);
+		head_max=_mm512_mask_max_epi32(head_max, w, head_max, head);
+		head=_mm512_add_epi32(head, _mm512_sub_epi32(_mm512_and_si512(_mm512_srli_epi32(e, I_DELTA), three), one));
+		row=_mm512_and_si512(e, next);
+	}
+	#undef LOAD
+	#undef STORE
+}
+#endif
+
+void turing_batch(tTape * tapes, tTransitions * t, int n, int max_steps, tStatus * status) {
+	int lanes=8, lane, i;
+	tBatch * b;
+#ifdef __x86_64__
+	int avx512=__builtin_cpu_supports("avx512f"), avx2=__builtin_cpu_supports("avx2");
+	if (avx512) lanes=16;
+#endif
+	if ((b=malloc(sizeof(tBatch)))==NULL) {
+		fprintf(stderr, "Can't allocate memory for the batch engine!\n");
+		exit(-1);
+	}
+	b->max_steps=max_steps;
+	b->tapes_in=tapes;
+	b->t=t;
+	b->status_in=status;
+	b->n=n;
+	b->next=0;
+	b->active=0;
+	b->table_size=0;
+	b->stride=0;
+	for (i=0; i<n; i++) {
+		if (b->table_size < t[i].states*(t[i].symbols+1))
+			b->table_size=t[i].states*(t[i].symbols+1);
+		if (b->stride < tapes[i].limit+STRIDE_EXTRA)
+			b->stride=tapes[i].limit+STRIDE_EXTRA;
+	}
+	// BLANK lanes, no guards yet
+	if ((b->tapes=calloc(lanes, b->stride))==NULL) {
+		fprintf(stderr, "Can't allocate memory for the batch engine!\n");
+		exit(-1);
+	}
+	memset(b->end, 0, sizeof(b->end));
+	memset(b->dirty, 0, sizeof(b->dirty));
+	memset(b->loop, 0, sizeof(b->loop));
+	int flat[lanes*b->table_size];
+	uchar used[lanes*b->table_size];
+	b->flat=flat;
+	b->used=used;
+	memset(b->row, 0, sizeof(b->row));
+	memset(b->head, 0, sizeof(b->head));
+	memset(b->limit, 0, sizeof(b->limit));
+	memset(b->loop_row, -1, sizeof(b->loop_row));
+	for (lane=0; lane<lanes; lane++)
+		load_lane(b, lane);
+#ifdef __x86_64__
+	if (avx512) run_avx512(b);
+	else if (avx2) run_avx2(b);
+	else
+#endif
+		run_generic(b, lanes);
+	for (lane=0; lane<lanes; lane++)
+		loop_check_free(b->loop+lane);
+	free(b->tapes);
+	free(b);
+}
@@ -0,0 +1,16 @@
+#ifndef TURING_BATCH_H
+#define TURING_BATCH_H
+
+#include "turing.h"
+
+#define BATCH_MAX_LANES 16
+
+/**
+ * Runs n machines in lockstep, the i-th machine with the table t[i] on the tape tapes[i].
+ * Up to 16 machines share the vector lanes (AVX-512), 8 with AVX2;
+ * without them, the lanes are interleaved by plain C loops.
+ * The resulting status[i] and tapes[i] are identical to turing(tapes+i, t+i, max_steps, status+i).
+ */
+void turing_batch(tTape * tapes, tTransitions * t, int n, int max_steps, tStatus * status);
+
+#endif
@@ -0,0 +1,184 @@
+/**
+ * The body of the fast engine, included by turing.c once for each kernel:
+ * FAST_NAME is its name, FAST_STATES and FAST_SYMBOLS its shape - constants for the kernels
+ * specialized by KERNEL_SHAPES, t->states and t->symbols for the generic turing_fast().
+ * With the constants, the table is flattened into a fixed array by unrolled loops.
+ */
+void FAST_NAME(tTape * tape, tTransitions * t, int max_steps, tStatus * status) {
+	int states=FAST_STATES, symbols=FAST_SYMBOLS, cols=symbols+1, i, st, sy;
+	tFlatTransition flat[FAST_STATES*(FAST_SYMBOLS+1)], * row, * e, * loop_row=NULL;
+	schar * cell;
+	tTransTableItem * trans=t->table;
+	uchar bad=0;
+	int head=status->head, steps=status->steps, writes=status->writes, head_max=status->head_max,
+		limit, loop_head=0, period, looped=0, end, n;
+	ulong hash=0;
+	tLoopCheck * loop=&Loop;
+
+	if (t->states!=states || t->symbols!=symbols) {	// not the kernel's shape
+		turing_fast(tape, t, max_steps, status);
+		return;
+	}
+	if (status->state >= states) return;
+	// validate the table and the tape once, unknown symbols are left to the reference engine
+	for (i=0; i<states*symbols; i++)
+		bad|=TRANS_SYMBOL(trans[i]) >= symbols;
+	for (i=0; i<tape->dirty; i++)
+		bad|=(uchar)tape->content[i] >= symbols;
+	if (bad) {
+		turing(tape, t, max_steps, status);
+		return;
+	}
+	for (st=0, e=flat; st<states; st++, e++) {
+		for (sy=0; sy<symbols; sy++, e++, trans++) {
+			e->next=TRANS_STATE(*trans) >= states ? TRANS_STATE(*trans) : TRANS_STATE(*trans)*cols;
+			e->used=0;
+			e->write=TRANS_SYMBOL(*trans) >= 0;
+			e->symbol=e->write ? TRANS_SYMBOL(*trans) : sy;
+			e->change=e->symbol-sy;
+			e->shift=TRANS_SHIFT(*trans);
+			e->op=TRANS_STATE(*trans) >= states ? OP_HALT : TRANS_SHIFT(*trans);
+			if (sweeps && TRANS_STATE(*trans)==st && !e->change && (e->shift==R || e->shift==L))
+				e->op=e->shift==R ? OP_SWEEP_R : OP_SWEEP_L;
+		}
+		e->op=OP_GUARD;
+	}
+	if (head >= tape->size) tape_reserve(tape, head+1);
+// (re)places the guards around the allocated cells of the tape
+#define GUARDS() cell=tape->content; \
+				end=tape->size < tape->limit ? tape->size : tape->limit; \
+				memset(cell-GUARD_LEN, symbols, GUARD_LEN); \
+				memset(cell+end, symbols, GUARD_LEN)
+	GUARDS();
+
+	row=flat+status->state*cols;
+	loop_check_init(loop, steps, head, tape->limit);
+	limit=loop->next < max_steps ? loop->next : max_steps;
+// one step of the machine without the head movement
+#define STEP()	steps++; \
+				e->used=1; \
+				cell[head]=e->symbol; \
+				hash+=LOOP_HASH(0, e->change, head); \
+				writes+=e->write; \
+				head_max=e->write && head>head_max ? head : head_max; \
+				row=flat+e->next
+#ifdef __GNUC__
+	static const void * ops[]={&&op_r, &&op_l, &&op_rr, &&op_n, &&op_halt, &&op_guard, &&op_sweep_r, &&op_sweep_l};
+#define DISPATCH() if (steps >= limit || (row==loop_row && head==loop_head)) goto slow; \
+				e=row+cell[head]; \
+				goto *ops[e->op]
+#define FETCH() e=row+cell[head]; \
+				goto *ops[e->op]
+#else
+#define DISPATCH() goto dispatch
+#define FETCH() goto fetch
+#endif
+
+	DISPATCH();
+op_r:	STEP(); head++; DISPATCH();
+op_l:	STEP(); head--; DISPATCH();
+op_rr:	STEP(); head+=2; DISPATCH();
+op_n:	STEP(); DISPATCH();
+// the steps over the run of the symbol, up to the step limit, the saved configuration
+// of the loop detection and the end of the allocated cells (the guards end the run, too)
+op_sweep_r:
+	n=limit-steps;
+	if (row==loop_row && loop_head>head && loop_head-head<n) n=loop_head-head;
+	if (end-head<n) n=end-head;
+	n=run_right(cell+head, e->symbol, n);
+	steps+=n;
+	e->used=1;
+	if (e->write) {
+		writes+=n;
+		if (head+n-1>head_max) head_max=head+n-1;
+	}
+	head+=n;
+	DISPATCH();
+op_sweep_l:
+	n=limit-steps;
+	if (row==loop_row && loop_head<head && head-loop_head<n) n=head-loop_head;
+	if (head+1<n) n=head+1;
+	n=run_left(cell+head, e->symbol, n);
+	steps+=n;
+	e->used=1;
+	if (e->write) {
+		writes+=n;
+		if (head>head_max) head_max=head;
+	}
+	head-=n;
+	DISPATCH();
+#ifndef __GNUC__
+dispatch:
+	if (steps >= limit || (row==loop_row && head==loop_head)) goto slow;
+fetch:
+	e=row+cell[head];
+	switch (e->op) {
+		case R: goto op_r;
+		case L: goto op_l;
+		case RR: goto op_rr;
+		case N: goto op_n;
+		case OP_HALT: goto op_halt;
+		case OP_GUARD: goto op_guard;
+		case OP_SWEEP_R: goto op_sweep_r;
+		case OP_SWEEP_L: goto op_sweep_l;
+	}
+#endif
+slow:			// the step limit, or saving and comparing the configuration for the loop detection
+	if (steps >= max_steps) goto done;
+	if (steps == loop->next) {
+		loop_check_save(loop, cell, end, steps, writes, row-flat, head, hash);
+		loop_row=row;
+		loop_head=head;
+	} else if (row==loop_row && head==loop_head && (period=loop_check_period(loop, cell, end, steps, hash))) {
+		loop_check_skip(loop, period, max_steps, &steps, &writes);
+		loop_row=NULL;
+		looped=1;
+	}
+	limit=loop->next < max_steps ? loop->next : max_steps;
+	if (steps >= limit) goto done;
+	FETCH();
+op_guard:		// the previous step moved the head out of the allocated cells
+	if (head<0 || head>=tape->limit) goto done;
+	tape_reserve(tape, head+1);
+	GUARDS();
+	FETCH();
+#undef STEP
+#undef DISPATCH
+#undef FETCH
+#undef GUARDS
+op_halt:		// the machine enters a final state: the last step, which can move the head out, too
+	steps++;
+	e->used=1;
+	cell[head]=e->symbol;
+	writes+=e->write;
+	if (e->write && head>head_max) head_max=head;
+	switch (e->shift) {
+		case L: head--; break;
+		case R: head++; break;
+		case RR: head+=2; break;
+	}
+	status->state=e->next;
+	goto finish;
+done:
+	status->state=(row-flat)/cols;
+	if (looped) status->error=ERR_LOOP;
+finish:
+	memset(cell+end, BLANK, GUARD_LEN);		// the end guard may lie on the cells beyond the limit
+	if (head<0 || head>=tape->limit) {
+		if (log_level>=LOG_DEBUG_3) fprintf(stderr, "Head out of bounds!\n");
+		status->error=ERR_BOUNDS;
+	}
+	if (t->used)
+		for (st=0, e=flat; st<states; st++, e++)
+			for (sy=0; sy<symbols; sy++, e++)
+				if (e->used) USED_SET(t->used, st*symbols+sy);
+	status->head=head;
+	status->steps=steps;
+	status->writes=writes;
+	status->head_max=head_max;
+	tape_written(tape, head_max);
+}
+
+#undef FAST_NAME
+#undef FAST_STATES
+#undef FAST_SYMBOLS
@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "turing_jit.h"
+#include "common.h"
+
+#ifdef __x86_64__
+#include <sys/mman.h>
+
+/**
+ * The code keeps the machine in callee-saved registers and uses rax, rcx, rdx as scratch
+ * (rdi keeps the context):
+ *   r12 cells, rbx head, r13 steps, r14 limit, r15 hash, rbp writes, r8 head_max,
+ *   r9 loop_state, r10 loop_head, r11 used
+ * The layout: the prologue (loads the registers, jumps to the entry state's body),
+ * the common exit (stores them, returns eax with the state in rcx), then for each state
+ *   check:	cmp r13, r14; jae slow; cmp r9, S; jne body; cmp rbx, r10; je slow
+ *   body:	movzx eax, [r12+rbx]; cmp eax, 1; jb item0; je item1; cmp eax, 3; jb item2; ...; jmp guard
+ *   slow, guard: the exits with the state
+ *   items:	the steps, each ending with a jmp to the next state's check (or a halt exit)
+ * and at the end the entry table of the bodies. The symbol dispatch by a compare per two
+ * symbols (the guard symbol falls through) is predicted better than a jump table: an indirect
+ * jump per step measured no faster than the fast engine's computed goto.
+ */
+enum {RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15};
+
+// upper bounds of the code, in bytes
+#define JIT_PROLOGUE 128
+#define JIT_STATE 96
+#define JIT_SYMBOL 16
+#define JIT_ITEM 64
+#define JIT_SIZE(states, symbols) (JIT_PROLOGUE + (states)*(JIT_STATE + (symbols)*(JIT_ITEM+JIT_SYMBOL)) + 8)
+
+// the labels: the exit, the entry table, then per state and per item
+#define LABEL_EXIT 0
+#define LABEL_ENTRIES 1
+#define LABEL_CHECK(s) (2+(s))
+#define LABEL_BODY(s) (2+states+(s))
+#define LABEL_SLOW(s) (2+2*states+(s))
+#define LABEL_GUARD(s) (2+3*states+(s))
+#define LABEL_ITEM(i) (2+4*states+(i))
+// their count, and of the rel32 fixups, for a machine of n items (states <= n)
+#define LABELS(n) (2+5*(n))
+#define FIXUPS(n) (1+8*(n))
+
+typedef struct {
+	int pos, label;		// a rel32 at pos, relative to the end of the instruction
+} tFixup;
+
+typedef struct {
+	uchar * start, * p;
+	int * label;		// positions
+	tFixup * fixup;
+	int fixups;
+} tEmitter;
+
+typedef struct {
+	uchar * code;
+	size_t capacity;
+	int failed;					// no executable memory, not tried again
+	tTransTableItem * table;	// of the compiled machine
+	int states, symbols, compiled;
+	int * label;
+	tFixup * fixup;
+	int items;					// the capacity of table, label and fixup, in items of the machine
+} tJit;
+
+static tJit Jit;
+#pragma omp threadprivate(Jit)
+
+#define EMIT(e, s) emit(e, s, sizeof(s)-1)
+
+static void emit(tEmitter * e, const char * bytes, int n) {
+	memcpy(e->p, bytes, n);
+	e->p+=n;
+}
+
+static void emit8(tEmitter * e, int v) {
+	*e->p++=v;
+}
+
+static void emit32(tEmitter * e, int v) {
+	memcpy(e->p, &v, 4);
+	e->p+=4;
+}
+
+// a rel32 to the label, resolved at the end
+static void rel32(tEmitter * e, int label) {
+	e->fixup[e->fixups].pos=e->p-e->start;
+	e->fixup[e->fixups++].label=label;
+	emit32(e, 0);
+}
+
+static void mark(tEmitter * e, int label) {
+	e->label[label]=e->p-e->start;
+}
+
+// mov reg, [rdi+disp] (op 0x8b) or mov [rdi+disp], reg (op 0x89)
+static void ctx_mov(tEmitter * e, int op, int reg, int disp) {
+	emit8(e, 0x48 | (reg>=R8)<<2);
+	emit8(e, op);
+	emit8(e, 0x40 | (reg&7)<<3 | RDI);
+	emit8(e, disp);
+}
+
+// mov ecx, state; mov eax, reason; jmp exit
+static void emit_exit(tEmitter * e, int state, int reason) {
+	EMIT(e, "\xb9");
+	emit32(e, state);
+	EMIT(e, "\xb8");
+	emit32(e, reason);
+	EMIT(e, "\xe9");
+	rel32(e, LABEL_EXIT);
+}
+
+static void emit_item(tEmitter * e, int states, int i, int sy, tTransTableItem item) {
+	int symbol=TRANS_SYMBOL(item), next=TRANS_STATE(item);
+
+	mark(e, LABEL_ITEM(i));
+	EMIT(e, "\x41\xc6\x83");				// mov byte [r11+i], 1
+	emit32(e, i);
+	emit8(e, 1);
+	EMIT(e, "\x49\xff\xc5");				// inc r13
+	if (symbol >= 0) {
+		EMIT(e, "\x41\xc6\x04\x1c");		// mov byte [r12+rbx], symbol
+		emit8(e, symbol);
+		EMIT(e, "\x48\xff\xc5"				// inc rbp
+				"\x4c\x39\xc3"				// cmp rbx, r8
+				"\x4c\x0f\x4f\xc3");		// cmovg r8, rbx
+		if (symbol!=sy) {
+			EMIT(e, "\x48\x8d\x43\x01"		// lea rax, [rbx+1]
+					"\x48\x6b\xc0");		// imul rax, rax, change
+			emit8(e, symbol-sy);
+			EMIT(e, "\x49\x01\xc7");		// add r15, rax
+		}
+	}
+	switch (TRANS_SHIFT(item)) {
+		case R: EMIT(e, "\x48\xff\xc3"); break;			// inc rbx
+		case L: EMIT(e, "\x48\xff\xcb"); break;			// dec rbx
+		case RR: EMIT(e, "\x48\x83\xc3\x02"); break;	// add rbx, 2
+	}
+	if (next >= states)
+		emit_exit(e, next, JIT_HALT);
+	else {
+		EMIT(e, "\xe9");
+		rel32(e, LABEL_CHECK(next));
+	}
+}
+
+static void emit_code(tEmitter * e, tTransitions * t) {
+	int states=t->states, symbols=t->symbols, s, sy, i;
+	long * address;
+
+	EMIT(e, "\x53\x55\x41\x54\x41\x55\x41\x56\x41\x57");	// push rbx, rbp, r12..r15
+	ctx_mov(e, 0x8b, R12, offsetof(tJitContext, cells));
+	ctx_mov(e, 0x8b, RBX, offsetof(tJitContext, head));
+	ctx_mov(e, 0x8b, R13, offsetof(tJitContext, steps));
+	ctx_mov(e, 0x8b, R14, offsetof(tJitContext, limit));
+	ctx_mov(e, 0x8b, R15, offsetof(tJitContext, hash));
+	ctx_mov(e, 0x8b, RBP, offsetof(tJitContext, writes));
+	ctx_mov(e, 0x8b, R8, offsetof(tJitContext, head_max));
+	ctx_mov(e, 0x8b, R9, offsetof(tJitContext, loop_state));
+	ctx_mov(e, 0x8b, R10, offsetof(tJitContext, loop_head));
+	ctx_mov(e, 0x8b, R11, offsetof(tJitContext, used));
+	ctx_mov(e, 0x8b, RAX, offsetof(tJitContext, state));
+	EMIT(e, "\x48\x8d\x15");					// lea rdx, [entries]
+	rel32(e, LABEL_ENTRIES);
+	EMIT(e, "\xff\x24\xc2");					// jmp [rdx+rax*8]
+
+	mark(e, LABEL_EXIT);
+	ctx_mov(e, 0x89, RBX, offsetof(tJitContext, head));
+	ctx_mov(e, 0x89, R13, offsetof(tJitContext, steps));
+	ctx_mov(e, 0x89, R15, offsetof(tJitContext, hash));
+	ctx_mov(e, 0x89, RBP, offsetof(tJitContext, writes));
+	ctx_mov(e, 0x89, R8, offsetof(tJitContext, head_max));
+	ctx_mov(e, 0x89, RCX, offsetof(tJitContext, state));
+	EMIT(e, "\x41\x5f\x41\x5e\x41\x5d\x41\x5c\x5d\x5b\xc3");	// pop r15..r12, rbp, rbx; ret
+
+	for (s=0; s<states; s++) {
+		mark(e, LABEL_CHECK(s));
+		EMIT(e, "\x4d\x39\xf5\x0f\x83");		// cmp r13, r14; jae slow
+		rel32(e, LABEL_SLOW(s));
+		EMIT(e, "\x49\x81\xf9");				// cmp r9, s
+		emit32(e, s);
+		EMIT(e, "\x75\x09"						// jne body
+				"\x4c\x39\xd3\x0f\x84");		// cmp rbx, r10; je slow
+		rel32(e, LABEL_SLOW(s));
+		mark(e, LABEL_BODY(s));
+		EMIT(e, "\x41\x0f\xb6\x04\x1c");		// movzx eax, byte [r12+rbx]
+		for (sy=0; sy<symbols; sy+=2) {
+			EMIT(e, "\x83\xf8");				// cmp eax, sy+1
+			emit8(e, sy+1);
+			EMIT(e, "\x0f\x82");				// jb item
+			rel32(e, LABEL_ITEM(s*symbols+sy));
+			if (sy+1 < symbols) {
+				EMIT(e, "\x0f\x84");			// je item+1
+				rel32(e, LABEL_ITEM(s*symbols+sy+1));
+			}
+		}
+		EMIT(e, "\xe9");						// jmp guard
+		rel32(e, LABEL_GUARD(s));
+		mark(e, LABEL_SLOW(s));
+		emit_exit(e, s, JIT_SLOW);
+		mark(e, LABEL_GUARD(s));
+		emit_exit(e, s, JIT_GUARD);
+		for (sy=0; sy<symbols; sy++)
+			emit_item(e, states, s*symbols+sy, sy, t->table[s*symbols+sy]);
+	}
+
+	while ((e->p-e->start)%8) emit8(e, 0xcc);
+	mark(e, LABEL_ENTRIES);
+	address=(long *)e->p;
+	for (s=0; s<states; s++)
+		*address++=(long)(e->start+e->label[LABEL_BODY(s)]);
+	e->p=(uchar *)address;
+
+	for (i=0; i<e->fixups; i++) {
+		int rel=e->label[e->fixup[i].label]-(e->fixup[i].pos+4);
+		memcpy(e->start+e->fixup[i].pos, &rel, 4);
+	}
+}
+
+// the code buffer and the emitter's arrays for the machine
+static int jit_reserve(int states, int symbols) {
+	size_t size=JIT_SIZE(states, symbols);
+	int items=states*symbols;
+
+	if (size > Jit.capacity) {
+		if (Jit.code) munmap(Jit.code, Jit.capacity);
+		Jit.capacity=0;
+		Jit.code=mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (Jit.code==MAP_FAILED) {
+			Jit.code=NULL;
+			return 0;
+		}
+		Jit.capacity=size;
+	}
+	if (items > Jit.items) {
+		Jit.table=realloc(Jit.table, items*sizeof(tTransTableItem));
+		Jit.label=realloc(Jit.label, LABELS(items)*sizeof(int));
+		Jit.fixup=realloc(Jit.fixup, FIXUPS(items)*sizeof(tFixup));
+		if (Jit.table==NULL || Jit.label==NULL || Jit.fixup==NULL) {
+			fprintf(stderr, "Can't allocate memory for the JIT!\n");
+			exit(-1);
+		}
+		Jit.items=items;
+	}
+	return 1;
+}
+
+tJitCode jit_compile(tTransitions * t) {
+	tEmitter e;
+	int states=t->states, symbols=t->symbols;
+
+	if (Jit.failed) return NULL;
+	if (Jit.compiled && Jit.states==states && Jit.symbols==symbols &&
+			!memcmp(Jit.table, t->table, states*symbols*sizeof(tTransTableItem)))
+		return (tJitCode)Jit.code;
+	Jit.compiled=0;
+	if (!jit_reserve(states, symbols) || mprotect(Jit.code, Jit.capacity, PROT_READ | PROT_WRITE)) {
+		fprintf(stderr, "No executable memory, the JIT is off!\n");
+		Jit.failed=1;
+		return NULL;
+	}
+	e.start=e.p=Jit.code;
+	e.label=Jit.label;
+	e.fixup=Jit.fixup;
+	e.fixups=0;
+	emit_code(&e, t);
+	if (mprotect(Jit.code, Jit.capacity, PROT_READ | PROT_EXEC)) {
+		fprintf(stderr, "No executable memory, the JIT is off!\n");
+		Jit.failed=1;
+		return NULL;
+	}
+	memcpy(Jit.table, t->table, states*symbols*sizeof(tTransTableItem));
+	Jit.states=states;
+	Jit.symbols=symbols;
+	Jit.compiled=1;
+	return (tJitCode)Jit.code;
+}
+
+#else
+
+tJitCode jit_compile(tTransitions * t) {
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef TURING_JIT_H
+#define TURING_JIT_H
+
+#include "turing.h"
+
+/**
+ * The registers of the native code, loaded from and stored back to the context
+ * by the code itself. Offsets are fixed, the code generator relies on them.
+ */
+typedef struct {
+	schar * cells;		// 0: the tape content, with the guards
+	long head;			// 8
+	long steps;			// 16
+	long limit;			// 24: the code returns JIT_SLOW before the step with steps >= limit
+	ulong hash;			// 32: LOOP_HASH sum
+	long writes;		// 40
+	long head_max;		// 48
+	long loop_state;	// 56: the code returns JIT_SLOW in this state at loop_head, -1 never
+	long loop_head;		// 64
+	uchar * used;		// 72: [states*symbols], the code sets the items it runs to 1
+	long state;			// 80: entered here; the state of the exit, or the final one
+} tJitContext;
+
+// why the native code returned
+enum {
+	JIT_SLOW,	// the step limit or the loop check position, before the step
+	JIT_GUARD,	// a guard cell read, before the step
+	JIT_HALT	// the step into the final state was done
+};
+
+typedef int (*tJitCode)(tJitContext * ctx);
+
+/**
+ * Compiles the machine (its symbols must be valid) into x86-64 code: a block per state,
+ * which tests the step limit and the loop check position, loads the symbol under the head
+ * and branches on it to a block per item, which does the step with its constants
+ * and jumps straight to the next state's block.
+ * The code buffer is the calling thread's; the last machine is kept compiled.
+ * @return NULL if the JIT isn't available (not x86-64, or no executable memory)
+ */
+tJitCode jit_compile(tTransitions * t);
+
+#endif